@@ -0,0 +1,112 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "GooseVF/FileWriter.h"
+
+namespace GooseVF::Bench {
+    enum class SizeDistribution {
+        Fixed,     // Every file has medianSize bytes
+        Uniform,   // Between minSize and maxSize
+        LogNormal  // Around medianSize, clamped to [minSize, maxSize]. Most files small, a few big ones
+    };
+
+    enum class Content {
+        Random,  // Doesn't compress
+        Text     // Compresses about as well as typical text assets
+    };
+
+    struct Config {
+        unsigned int entries = 10000;  // Files, directories come on top
+        unsigned int depth = 3;
+        unsigned int fanout = 8;  // Subdirectories per directory
+        SizeDistribution distribution = SizeDistribution::LogNormal;
+        unsigned long long minSize = 256;
+        unsigned long long medianSize = 16 << 10;
+        unsigned long long maxSize = 4 << 20;
+        Content content = Content::Random;
+
+        int formatVersion = 2;
+        int codec = CODEC_STORED;
+        unsigned int threads = 0;  // Reader threads for concurrent scenarios, 0 - one per hardware thread
+        unsigned int repeat = 5;
+        unsigned int seed = 1;
+        unsigned int lookups = 100000;
+
+        std::string workDir = "goosevf_bench";
+        std::string output;  // JSON results, stdout if empty
+        std::string label;   // Free-form tag stored with results, e.g. a commit or machine name
+        std::vector<std::string> scenarios;  // All if empty
+        bool keep = false;                   // Keep generated files
+    };
+
+    // Source files written to disk plus the paths they get in the archive
+    struct SyntheticTree {
+        std::string root;
+        std::vector<std::string> sources;
+        std::vector<std::string> targets;
+        std::vector<unsigned long long> sizes;
+        std::vector<std::string> directories;  // Archive paths
+        unsigned long long totalSize = 0;
+    };
+
+    SyntheticTree generateTree(const Config& config, const std::string& root);
+
+    // Packs the tree with the format and codec of the config, setup can adjust the writer further
+    void writeArchive(const Config& config, const SyntheticTree& tree, const std::string& path, const std::function<void(FileWriter&)>& setup = nullptr);
+
+    // Evicts the file from the page cache, false if the platform can't do it
+    bool dropCache(const std::string& path);
+
+    class Report {
+       public:
+        void setConfig(const std::string& key, const std::string& value);
+        void setConfig(const std::string& key, double value);
+
+        // Repeated measurements are stored as median, min and max
+        void add(const std::string& scenario, const std::string& metric, const std::vector<double>& samples, const std::string& unit);
+        void add(const std::string& scenario, const std::string& metric, double value, const std::string& unit);
+
+        void write(std::ostream& out) const;
+        void print(std::ostream& out) const;  // Human-readable summary
+
+       private:
+        struct Result {
+            std::string scenario;
+            std::string metric;
+            std::string unit;
+            double median;
+            double min;
+            double max;
+            size_t samples;
+        };
+
+        std::vector<std::pair<std::string, std::string>> _config;  // Values are JSON already
+        std::vector<Result> _results;
+    };
+
+    class Timer {
+       public:
+        Timer() : _start(std::chrono::steady_clock::now()) {}
+
+        double seconds() const {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+        }
+
+       private:
+        std::chrono::steady_clock::time_point _start;
+    };
+
+    struct Scenario {
+        const char* name;
+        const char* description;
+        std::function<void(const Config& config, const SyntheticTree& tree, Report& report)> run;
+    };
+
+    const std::vector<Scenario>& scenarios();
+}  // namespace GooseVF::Bench
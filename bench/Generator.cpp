@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+#include "Bench.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define GENERATOR_BLOCK_SIZE (1 << 20)
+#define LOGNORMAL_SIGMA 1.5  // Spread of sizes around the median, 1.5 puts ~7% of files above 10x median
+
+using namespace GooseVF::Bench;
+
+namespace {
+    const char* WORDS[] = {"goose", "honk", "archive", "texture", "model", "level", "sound", "shader", "the", "of",
+                           "and", "entry", "file", "data", "{", "}", "=", "0.5", "1024", "\n"};
+
+    void fillBlock(std::vector<char>& block, Content content, std::mt19937_64& random) {
+        if (content == Content::Random) {
+            for (size_t i = 0; i + 8 <= block.size(); i += 8) {
+                auto value = random();
+                std::memcpy(block.data() + i, &value, 8);
+            }
+            return;
+        }
+
+        size_t position = 0;
+        while (position < block.size()) {
+            auto* word = WORDS[random() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+            auto length = std::min(std::strlen(word), block.size() - position);
+            std::memcpy(block.data() + position, word, length);
+            position += length;
+            if (position < block.size())
+                block[position++] = ' ';
+        }
+    }
+
+    unsigned long long pickSize(const Config& config, std::mt19937_64& random) {
+        switch (config.distribution) {
+            case SizeDistribution::Fixed:
+                return config.medianSize;
+            case SizeDistribution::Uniform:
+                return std::uniform_int_distribution<unsigned long long>(config.minSize, config.maxSize)(random);
+            case SizeDistribution::LogNormal:
+            default: {
+                std::lognormal_distribution<double> distribution(std::log((double)config.medianSize), LOGNORMAL_SIGMA);
+                auto size = (unsigned long long)distribution(random);
+                return std::clamp(size, config.minSize, config.maxSize);
+            }
+        }
+    }
+}  // namespace
+
+SyntheticTree GooseVF::Bench::generateTree(const Config& config, const std::string& root) {
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+
+    SyntheticTree tree;
+    tree.root = root;
+
+    // Directories level by level, never more of them than files
+    std::vector<std::string> level = {""};
+    std::vector<std::string> all = {""};
+    for (unsigned int depth = 0; depth < config.depth && all.size() < config.entries; depth++) {
+        std::vector<std::string> next;
+        for (auto& parent : level) {
+            for (unsigned int i = 0; i < config.fanout && all.size() < config.entries; i++) {
+                auto path = (parent.empty() ? "" : parent + "\\") + "dir" + std::to_string(i);
+                next.push_back(path);
+                all.push_back(path);
+            }
+        }
+        level.swap(next);
+    }
+    for (auto& directory : all) {
+        if (directory.empty())
+            continue;
+        tree.directories.push_back(directory);
+        auto onDisk = directory;
+        std::replace(onDisk.begin(), onDisk.end(), '\\', '/');
+        std::filesystem::create_directories(root + "/" + onDisk);
+    }
+
+    std::mt19937_64 random(config.seed);
+    std::vector<char> block(GENERATOR_BLOCK_SIZE);
+    for (unsigned int i = 0; i < config.entries; i++) {
+        auto& directory = all[random() % all.size()];
+        auto target = (directory.empty() ? "" : directory + "\\") + "file" + std::to_string(i) + ".dat";
+        auto source = target;
+        std::replace(source.begin(), source.end(), '\\', '/');
+        source = root + "/" + source;
+
+        auto size = pickSize(config, random);
+        std::ofstream out(source, std::ios::binary);
+        if (!out.is_open())
+            throw std::runtime_error("Unable to create " + source);
+        for (unsigned long long written = 0; written < size; written += block.size()) {
+            fillBlock(block, config.content, random);
+            out.write(block.data(), std::min<unsigned long long>(block.size(), size - written));
+        }
+        if (!out)
+            throw std::runtime_error("Unable to write " + source);
+
+        tree.sources.push_back(source);
+        tree.targets.push_back(target);
+        tree.sizes.push_back(size);
+        tree.totalSize += size;
+    }
+    return tree;
+}
+
+void GooseVF::Bench::writeArchive(const Config& config, const SyntheticTree& tree, const std::string& path, const std::function<void(FileWriter&)>& setup) {
+    FileWriter writer;
+    writer.setFormatVersion(config.formatVersion);
+    if (config.codec != CODEC_STORED)
+        writer.setCompression(config.codec);
+    if (setup)
+        setup(writer);
+
+    for (size_t i = 0; i < tree.sources.size(); i++) {
+        writer.addFile(tree.sources[i], tree.targets[i]);
+    }
+    writer.save(path);
+}
+
+bool GooseVF::Bench::dropCache(const std::string& path) {
+#if defined(__linux__) && defined(POSIX_FADV_DONTNEED)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    fdatasync(fd);  // Dirty pages can't be dropped
+    bool dropped = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return dropped;
+#else
+    (void)path;
+    return false;
+#endif
+}
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+#include "Bench.h"
+
+using namespace GooseVF::Bench;
+
+namespace {
+    std::string quote(const std::string& s) {
+        std::string result = "\"";
+        for (unsigned char c : s) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += c;
+            } else if (c < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                result += escaped;
+            } else {
+                result += c;
+            }
+        }
+        return result + "\"";
+    }
+
+    std::string number(double value) {
+        if (!std::isfinite(value))
+            return "null";
+        std::ostringstream out;
+        out << std::setprecision(10) << value;
+        return out.str();
+    }
+}  // namespace
+
+void Report::setConfig(const std::string& key, const std::string& value) {
+    _config.emplace_back(key, quote(value));
+}
+
+void Report::setConfig(const std::string& key, double value) {
+    _config.emplace_back(key, number(value));
+}
+
+void Report::add(const std::string& scenario, const std::string& metric, const std::vector<double>& samples, const std::string& unit) {
+    if (samples.empty())
+        return;
+
+    auto sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    auto middle = sorted.size() / 2;
+    auto median = (sorted.size() % 2) ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) / 2;
+    _results.push_back(Result{scenario, metric, unit, median, sorted.front(), sorted.back(), sorted.size()});
+}
+
+void Report::add(const std::string& scenario, const std::string& metric, double value, const std::string& unit) {
+    add(scenario, metric, std::vector<double>{value}, unit);
+}
+
+void Report::write(std::ostream& out) const {
+    out << "{\n  \"config\": {";
+    for (size_t i = 0; i < _config.size(); i++) {
+        out << (i ? ",\n    " : "\n    ") << quote(_config[i].first) << ": " << _config[i].second;
+    }
+    out << "\n  },\n  \"results\": [";
+    for (size_t i = 0; i < _results.size(); i++) {
+        auto& result = _results[i];
+        out << (i ? ",\n    " : "\n    ") << "{\"scenario\": " << quote(result.scenario) << ", \"metric\": " << quote(result.metric)
+            << ", \"unit\": " << quote(result.unit) << ", \"median\": " << number(result.median) << ", \"min\": " << number(result.min)
+            << ", \"max\": " << number(result.max) << ", \"samples\": " << result.samples << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void Report::print(std::ostream& out) const {
+    for (auto& result : _results) {
+        out << std::left << std::setw(14) << result.scenario << std::setw(34) << result.metric << std::right << std::setw(14)
+            << number(result.median) << " " << result.unit;
+        if (result.samples > 1)
+            out << "  (" << number(result.min) << " .. " << number(result.max) << ")";
+        out << "\n";
+    }
+}
@@ -0,0 +1,647 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <thread>
+
+#include "Bench.h"
+#include "GooseVF/FileReader.h"
+#include "GooseVF/MountManager.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define MIB (1024.0 * 1024.0)
+#define BATCH_SIZE 500         // Files per readFiles call in the batch scenario
+#define COPY_FILE_COUNT 4      // Big stored files packed and extracted by the copy scenario
+#define COPY_FILE_SIZE (64 << 20)
+#define DIRECT_IO_BLOCK 4096
+#define MOUNT_PATCH_COUNT 3    // Archives mounted on top of the base one, each replacing a part of the files
+#define MOUNT_PATCH_SHARE 10   // Percent of files every patch replaces
+#define SCALING_FILES_PER_DIR 1000
+#define LOOKUP_SHAPE_FILES 50000  // Files of the flat and the deep archive the lookup scenario compares
+#define LOOKUP_DEEP_LEVELS 6      // Directory levels above every file of the deep archive
+#define LOOKUP_DEEP_FANOUT 8      // Subdirectories of every directory of the deep archive
+#define CACHE_HOT_SHARE 10     // Percent of files read over and over by the cache scenario
+#define CACHE_READS 10000
+#define REPLAY_SHARE 20        // Percent of files read by the trace the replay scenario records
+
+using namespace GooseVF;
+using namespace GooseVF::Bench;
+
+namespace {
+    volatile size_t sink;  // Keeps results of measured loops alive
+
+    std::string archivePath(const Config& config, const std::string& name) {
+        return config.workDir + "/" + name;
+    }
+
+    // Default archive of the run, built once from the synthetic tree
+    const std::string& mainArchive(const Config& config, const SyntheticTree& tree) {
+        static std::string path;
+        if (path.empty()) {
+            path = archivePath(config, "main.honk");
+            writeArchive(config, tree, path);
+        }
+        return path;
+    }
+
+    std::vector<size_t> shuffled(size_t count, unsigned int seed) {
+        std::vector<size_t> order(count);
+        for (size_t i = 0; i < count; i++)
+            order[i] = i;
+        std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+        return order;
+    }
+
+    std::string modeName(OpenMode mode) {
+        switch (mode) {
+            case OpenMode::Mapped:
+                return "mapped";
+            case OpenMode::Lazy:
+                return "lazy";
+            default:
+                return "stream";
+        }
+    }
+
+    void save(const Config& config, const SyntheticTree& tree, Report& report) {
+        auto path = archivePath(config, "save.honk");
+        std::vector<double> throughput, rate;
+        for (unsigned int i = 0; i < config.repeat; i++) {
+            Timer timer;
+            writeArchive(config, tree, path);
+            auto seconds = timer.seconds();
+            throughput.push_back(tree.totalSize / MIB / seconds);
+            rate.push_back(tree.sources.size() / seconds);
+        }
+        report.add("save", "throughput", throughput, "MiB/s");
+        report.add("save", "files", rate, "files/s");
+        report.add("save", "archive_size", std::filesystem::file_size(path) / MIB, "MiB");
+        report.add("save", "source_size", tree.totalSize / MIB, "MiB");
+
+        // One pass through a stream, like to a pipe: no kernel copies and no seeking back
+        std::vector<double> streamed;
+        for (unsigned int i = 0; i < config.repeat; i++) {
+            FileWriter writer;
+            writer.setFormatVersion(FORMAT_VERSION_STREAMED);
+            if (config.codec != CODEC_STORED)
+                writer.setCompression(config.codec);
+            for (size_t j = 0; j < tree.sources.size(); j++) {
+                writer.addFile(tree.sources[j], tree.targets[j]);
+            }
+
+            Timer timer;
+            std::ofstream out(path, std::ios::binary);
+            writer.save(out);
+            out.close();
+            streamed.push_back(tree.totalSize / MIB / timer.seconds());
+        }
+        report.add("save", "stream_throughput", streamed, "MiB/s");
+        std::filesystem::remove(path);
+    }
+
+    void openLatency(const Config& config, const SyntheticTree& tree, Report& report) {
+        auto& path = mainArchive(config, tree);
+        for (auto mode : {OpenMode::Stream, OpenMode::Mapped, OpenMode::Lazy}) {
+            std::vector<double> warm, cold;
+            for (unsigned int i = 0; i < config.repeat; i++) {
+                Timer timer;
+                FileReader reader(path, mode);
+                warm.push_back(timer.seconds() * 1000);
+            }
+            for (unsigned int i = 0; i < config.repeat && dropCache(path); i++) {
+                Timer timer;
+                FileReader reader(path, mode);
+                cold.push_back(timer.seconds() * 1000);
+            }
+            report.add("open", modeName(mode) + "_warm", warm, "ms");
+            report.add("open", modeName(mode) + "_cold", cold, "ms");
+        }
+    }
+
+    // Open latency over entry count, with empty files so only the index matters.
+    // Version 4 is opened lazily, its first lookup into a directory pays for loading it
+    void openScaling(const Config& config, const SyntheticTree&, Report& report) {
+        auto empty = archivePath(config, "empty.dat");
+        std::ofstream(empty).close();
+
+        std::vector<int> versions = {FORMAT_VERSION_LEGACY};
+        for (int version : {config.formatVersion, FORMAT_VERSION_LAZY}) {
+            if (std::find(versions.begin(), versions.end(), version) == versions.end())
+                versions.push_back(version);
+        }
+
+        for (unsigned int count : {10000U, 100000U, 1000000U}) {
+            for (int version : versions) {
+                auto path = archivePath(config, "scaling.honk");
+                {
+                    FileWriter writer;
+                    writer.setFormatVersion(version);
+                    for (unsigned int i = 0; i < count; i++) {
+                        writer.addFile(empty, "dir" + std::to_string(i / SCALING_FILES_PER_DIR) + "\\file" + std::to_string(i));
+                    }
+                    writer.save(path);
+                }
+
+                bool lazy = version >= FORMAT_VERSION_LAZY;
+                auto name = "v" + std::to_string(version) + (lazy ? "_lazy_" : "_") + std::to_string(count);
+                std::vector<double> samples, lookups;
+                for (unsigned int i = 0; i < config.repeat; i++) {
+                    Timer timer;
+                    FileReader reader(path, lazy ? OpenMode::Lazy : OpenMode::Mapped);
+                    samples.push_back(timer.seconds() * 1000);
+
+                    auto file = count / 2 + i;
+                    Timer lookupTimer;
+                    if (!reader.exists("dir" + std::to_string(file / SCALING_FILES_PER_DIR) + "\\file" + std::to_string(file)))
+                        throw std::runtime_error("Scaling archive is incomplete");
+                    lookups.push_back(lookupTimer.seconds() * 1000000);
+                }
+                report.add("open_scaling", name, samples, "ms");
+                report.add("open_scaling", name + "_first_lookup", lookups, "us");
+                std::filesystem::remove(path);
+            }
+        }
+        std::filesystem::remove(empty);
+    }
+
+    void lookup(const Config& config, const SyntheticTree& tree, Report& report) {
+        FileReader reader(mainArchive(config, tree), OpenMode::Mapped);
+        std::mt19937 random(config.seed);
+        std::vector<std::string> hits, misses;
+        for (unsigned int i = 0; i < config.lookups; i++) {
+            auto& target = tree.targets[random() % tree.targets.size()];
+            hits.push_back(target);
+            misses.push_back(target + ".missing");
+        }
+
+        auto measure = [&](const std::string& metric, const std::function<bool(const std::string&)>& query, const std::vector<std::string>& paths) {
+            std::vector<double> samples;
+            size_t found = 0;
+            for (unsigned int i = 0; i < config.repeat; i++) {
+                Timer timer;
+                for (auto& path : paths)
+                    found += query(path);
+                samples.push_back(timer.seconds() * 1e9 / paths.size());
+            }
+            report.add("lookup", metric, samples, "ns/op");
+            sink = found;
+        };
+        measure("exists_hit", [&](const std::string& path) { return reader.exists(path); }, hits);
+        measure("exists_miss", [&](const std::string& path) { return reader.exists(path); }, misses);
+        measure("is_file", [&](const std::string& path) { return reader.is_file(path); }, hits);
+
+        std::vector<char> buffer;
+        measure("read_file", [&](const std::string& path) {
+            reader.readFile(path, buffer);
+            return true;
+        }, std::vector<std::string>(hits.begin(), hits.begin() + std::min<size_t>(hits.size(), 10000)));
+
+        // Same number of empty files all in one directory and spread over a deep tree, so only the index matters
+        auto empty = archivePath(config, "empty.dat");
+        std::ofstream(empty).close();
+        for (bool deep : {false, true}) {
+            std::vector<std::string> paths;
+            for (unsigned int i = 0; i < LOOKUP_SHAPE_FILES; i++) {
+                std::string path;
+                for (unsigned int level = 0, rest = i; deep && level < LOOKUP_DEEP_LEVELS; level++, rest /= LOOKUP_DEEP_FANOUT)
+                    path += "dir" + std::to_string(rest % LOOKUP_DEEP_FANOUT) + "\\";
+                paths.push_back(path + "file" + std::to_string(i));
+            }
+
+            auto path = archivePath(config, "lookup_shape.honk");
+            {
+                FileWriter writer;
+                writer.setFormatVersion(config.formatVersion);
+                for (auto& file : paths)
+                    writer.addFile(empty, file);
+                writer.save(path);
+            }
+
+            {
+                FileReader shaped(path, OpenMode::Mapped);
+                std::vector<std::string> shapeHits, shapeMisses;
+                for (unsigned int i = 0; i < config.lookups; i++) {
+                    auto& target = paths[random() % paths.size()];
+                    shapeHits.push_back(target);
+                    shapeMisses.push_back(target + ".missing");
+                }
+                std::string shape = deep ? "deep_" : "flat_";
+                measure(shape + "exists_hit", [&](const std::string& query) { return shaped.exists(query); }, shapeHits);
+                measure(shape + "exists_miss", [&](const std::string& query) { return shaped.exists(query); }, shapeMisses);
+            }
+            std::filesystem::remove(path);
+        }
+        std::filesystem::remove(empty);
+    }
+
+    void iterate(const Config& config, const SyntheticTree& tree, Report& report) {
+        FileReader reader(mainArchive(config, tree), OpenMode::Mapped);
+        std::vector<double> paths, names;
+        size_t count = 0;
+        for (unsigned int i = 0; i < config.repeat; i++) {
+            count = 0;
+            Timer timer;
+            reader.iterateEntries([&](const std::string& path, bool) { count += !path.empty(); });
+            paths.push_back(timer.seconds() * 1000);
+
+            Timer rangeTimer;
+            size_t length = 0;
+            for (auto& entry : reader.entries())
+                length += entry.name().size();  // Names only, no path building
+            names.push_back(rangeTimer.seconds() * 1000);
+            sink = length;
+        }
+        report.add("iterate", "iterate_entries", paths, "ms");
+        report.add("iterate", "entry_range_names", names, "ms");
+        report.add("iterate", "entries", count, "entries");
+    }
+
+    void readBandwidth(const Config& config, const SyntheticTree& tree, Report& report) {
+        auto& path = mainArchive(config, tree);
+        auto order = shuffled(tree.targets.size(), config.seed);
+        bool canDrop = dropCache(path);
+
+        for (auto mode : {OpenMode::Stream, OpenMode::Mapped}) {
+            for (bool cold : {false, true}) {
+                if (cold && !canDrop)
+                    continue;
+                std::vector<double> samples;
+                for (unsigned int i = 0; i < config.repeat; i++) {
+                    if (cold)
+                        dropCache(path);
+                    FileReader reader(path, mode);
+                    std::vector<char> buffer;
+                    Timer timer;
+                    for (auto index : order)
+                        reader.readFile(tree.targets[index], buffer);
+                    samples.push_back(tree.totalSize / MIB / timer.seconds());
+                }
+                report.add("read", modeName(mode) + (cold ? "_cold" : "_warm"), samples, "MiB/s");
+            }
+        }
+    }
+
+    // Random reads of a small hot set, without a cache and with budgets below and above its size
+    void cache(const Config& config, const SyntheticTree& tree, Report& report) {
+        auto& path = mainArchive(config, tree);
+        auto hot = shuffled(tree.targets.size(), config.seed);
+        hot.resize(std::max<size_t>(1, hot.size() * CACHE_HOT_SHARE / 100));
+        unsigned long long hotSize = 0;
+        for (auto index : hot)
+            hotSize += tree.sizes[index];
+
+        std::mt19937 random(config.seed);
+        std::vector<size_t> reads(CACHE_READS);
+        for (auto& index : reads)
+            index = hot[random() % hot.size()];
+
+        for (auto budget : {0ULL, hotSize / 2, hotSize * 2}) {
+            std::string name = budget == 0 ? "off" : (budget < hotSize ? "half_hot_set" : "twice_hot_set");
+            std::vector<double> samples;
+            CacheStats stats;
+            for (unsigned int i = 0; i < config.repeat; i++) {
+                FileReader reader(path);
+                reader.setCacheSize(budget);
+                size_t total = 0;
+                Timer timer;
+                for (auto index : reads)
+                    total += reader.readFileShared(tree.targets[index])->size();
+                samples.push_back(timer.seconds() * 1e9 / reads.size());
+                stats = reader.cacheStats();
+                sink = total;
+            }
+            report.add("cache", name, samples, "ns/op");
+            if (budget > 0)
+                report.add("cache", name + "_hit_rate", 100.0 * stats.hits / (stats.hits + stats.misses), "%");
+        }
+    }
+
+    void batch(const Config& config, const SyntheticTree& tree, Report& report) {
+        auto& path = mainArchive(config, tree);
+        auto order = shuffled(tree.targets.size(), config.seed);
+        std::vector<std::string> paths;
+        unsigned long long size = 0;
+        for (size_t i = 0; i < std::min<size_t>(BATCH_SIZE, order.size()); i++) {
+            paths.push_back(tree.targets[order[i]]);
+            size += tree.sizes[order[i]];
+        }
+
+        FileReader reader(path);
+        std::vector<double> single, batched;
+        for (unsigned int i = 0; i < config.repeat; i++) {
+            std::vector<std::vector<char>> outputs(paths.size());
+            dropCache(path);
+            Timer timer;
+            for (size_t j = 0; j < paths.size(); j++)
+                reader.readFile(paths[j], outputs[j]);
+            single.push_back(timer.seconds() * 1000);
+
+            outputs.clear();
+            dropCache(path);
+            Timer batchTimer;
+            reader.readFiles(paths, outputs);
+            batched.push_back(batchTimer.seconds() * 1000);
+        }
+        report.add("batch", "read_file_loop", single, "ms");
+        report.add("batch", "read_files", batched, "ms");
+        report.add("batch", "batch_size", size / MIB, "MiB");
+    }
+
+    void concurrent(const Config& config, const SyntheticTree& tree, Report& report) {
+        FileReader reader(mainArchive(config, tree));
+        auto maxThreads = config.threads > 0 ? config.threads : std::max(1U, std::thread::hardware_concurrency());
+        auto order = shuffled(tree.targets.size(), config.seed);
+
+        for (unsigned int threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+            std::vector<double> samples;
+            for (unsigned int i = 0; i < config.repeat; i++) {
+                std::atomic<size_t> next(0);
+                std::atomic<unsigned long long> bytes(0);
+                Timer timer;
+                std::vector<std::thread> pool;
+                for (unsigned int t = 0; t < threads; t++) {
+                    pool.emplace_back([&]() {
+                        std::vector<char> buffer;
+                        for (auto j = next++; j < order.size(); j = next++) {
+                            reader.readFile(tree.targets[order[j]], buffer);
+                            bytes += buffer.size();
+                        }
+                    });
+                }
+                for (auto& thread : pool)
+                    thread.join();
+                samples.push_back(bytes / MIB / timer.seconds());
+            }
+            report.add("concurrent", "threads_" + std::to_string(threads), samples, "MiB/s");
+            if (threads == maxThreads)
+                break;
+        }
+    }
+
+    // Pack and extract of big stored files, which go through the kernel copy path
+    void copy(const Config& config, const SyntheticTree&, Report& report) {
+        Config copyConfig = config;
+        copyConfig.entries = COPY_FILE_COUNT;
+        copyConfig.depth = 0;
+        copyConfig.distribution = SizeDistribution::Fixed;
+        copyConfig.medianSize = COPY_FILE_SIZE;
+        copyConfig.codec = CODEC_STORED;
+        auto tree = generateTree(copyConfig, archivePath(config, "copy_source"));
+        auto path = archivePath(config, "copy.honk");
+        auto output = archivePath(config, "copy.out");
+
+        std::vector<double> pack, extract;
+        for (unsigned int i = 0; i < config.repeat; i++) {
+            Timer timer;
+            writeArchive(copyConfig, tree, path);
+            pack.push_back(tree.totalSize / MIB / timer.seconds());
+
+            FileReader reader(path);
+            Timer extractTimer;
+            for (auto& target : tree.targets)
+                reader.extractFile(target, output);
+            extract.push_back(tree.totalSize / MIB / extractTimer.seconds());
+        }
+        report.add("copy", "pack", pack, "MiB/s");
+        report.add("copy", "extract", extract, "MiB/s");
+
+        std::filesystem::remove(path);
+        std::filesystem::remove(output);
+        std::filesystem::remove_all(tree.root);
+    }
+
+#ifdef __linux__
+    // Reads entries straight from the disk, bypassing the page cache. Needs aligned entry data
+    double readDirect(const FileReader& reader, const std::string& path, const SyntheticTree& tree, const std::vector<size_t>& order) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+        if (fd < 0)
+            return -1;
+
+        void* buffer = nullptr;
+        auto maxSize = *std::max_element(tree.sizes.begin(), tree.sizes.end());
+        auto bufferSize = (maxSize + DIRECT_IO_BLOCK - 1) / DIRECT_IO_BLOCK * DIRECT_IO_BLOCK + DIRECT_IO_BLOCK;
+        if (posix_memalign(&buffer, DIRECT_IO_BLOCK, bufferSize) != 0) {
+            ::close(fd);
+            return -1;
+        }
+
+        unsigned long long bytes = 0;
+        Timer timer;
+        for (auto index : order) {
+            auto& target = tree.targets[index];
+            auto size = tree.sizes[index];
+            if (size == 0 || !reader.isAligned(target, DIRECT_IO_BLOCK))
+                continue;
+            auto length = (size + DIRECT_IO_BLOCK - 1) / DIRECT_IO_BLOCK * DIRECT_IO_BLOCK;
+            if (pread(fd, buffer, length, reader.dataOffset(target)) < (ssize_t)size)
+                break;
+            bytes += size;
+        }
+        auto seconds = timer.seconds();
+        std::free(buffer);
+        ::close(fd);
+        return bytes / MIB / seconds;
+    }
+#endif
+
+    void alignment(const Config& config, const SyntheticTree& tree, Report& report) {
+        auto& plain = mainArchive(config, tree);
+        auto aligned = archivePath(config, "aligned.honk");
+        writeArchive(config, tree, aligned, [](FileWriter& writer) { writer.setAlignment(DIRECT_IO_BLOCK); });
+
+        auto plainSize = (double)std::filesystem::file_size(plain);
+        report.add("alignment", "size_overhead", (std::filesystem::file_size(aligned) - plainSize) / plainSize * 100, "%");
+
+        auto order = shuffled(tree.targets.size(), config.seed);
+        std::vector<double> buffered, direct;
+        for (unsigned int i = 0; i < config.repeat && dropCache(aligned); i++) {
+            FileReader reader(aligned);
+            std::vector<char> buffer;
+            Timer timer;
+            for (auto index : order)
+                reader.readFile(tree.targets[index], buffer);
+            buffered.push_back(tree.totalSize / MIB / timer.seconds());
+
+#ifdef __linux__
+            if (config.codec == CODEC_STORED) {
+                dropCache(aligned);
+                auto throughput = readDirect(reader, aligned, tree, order);
+                if (throughput > 0)
+                    direct.push_back(throughput);
+            }
+#endif
+        }
+        report.add("alignment", "buffered_cold", buffered, "MiB/s");
+        report.add("alignment", "direct_io", direct, "MiB/s");
+        std::filesystem::remove(aligned);
+    }
+
+    void verify(const Config& config, const SyntheticTree& tree, Report& report) {
+        auto& path = mainArchive(config, tree);
+        for (auto mode : {OpenMode::Stream, OpenMode::Mapped}) {
+            FileReader reader(path, mode);
+            std::vector<double> warm;
+            for (unsigned int i = 0; i < config.repeat; i++) {
+                Timer timer;
+                reader.verifyAll(config.threads);
+                warm.push_back(tree.totalSize / MIB / timer.seconds());
+            }
+            report.add("verify", "verify_all_" + modeName(mode), warm, "MiB/s");
+
+            std::vector<char> buffer;
+            for (auto verifyMode : {VerifyMode::Never, VerifyMode::Always}) {
+                reader.setVerifyMode(verifyMode);
+                std::vector<double> samples;
+                for (unsigned int i = 0; i < config.repeat; i++) {
+                    Timer timer;
+                    for (auto& target : tree.targets)
+                        reader.readFile(target, buffer);
+                    samples.push_back(tree.totalSize / MIB / timer.seconds());
+                }
+                report.add("verify", std::string("read_") + (verifyMode == VerifyMode::Never ? "unverified_" : "verified_") + modeName(mode), samples, "MiB/s");
+            }
+        }
+    }
+
+    // Base archive with all files and patches replacing some of them, merged index against probing each reader
+    void mount(const Config& config, const SyntheticTree& tree, Report& report) {
+        std::vector<std::string> paths = {mainArchive(config, tree)};
+        std::mt19937 random(config.seed);
+        for (int i = 0; i < MOUNT_PATCH_COUNT; i++) {
+            SyntheticTree patch;
+            for (size_t j = 0; j < tree.sources.size(); j++) {
+                if (random() % 100 < MOUNT_PATCH_SHARE) {
+                    patch.sources.push_back(tree.sources[j]);
+                    patch.targets.push_back(tree.targets[j]);
+                }
+            }
+            paths.push_back(archivePath(config, "patch" + std::to_string(i) + ".honk"));
+            writeArchive(config, patch, paths.back());
+        }
+
+        MountManager mounts;
+        std::vector<std::unique_ptr<FileReader>> readers;
+        std::vector<double> mountTimes;
+        for (auto& path : paths) {
+            Timer timer;
+            mounts.mount(path, 0, OpenMode::Mapped);
+            mountTimes.push_back(timer.seconds() * 1000);
+            readers.push_back(std::make_unique<FileReader>(path, OpenMode::Mapped));
+        }
+        report.add("mount", "mount", mountTimes, "ms");
+
+        std::vector<std::string> queries;
+        for (unsigned int i = 0; i < config.lookups; i++)
+            queries.push_back(tree.targets[random() % tree.targets.size()]);
+
+        std::vector<double> merged, probing;
+        size_t found = 0;
+        for (unsigned int i = 0; i < config.repeat; i++) {
+            Timer timer;
+            for (auto& query : queries)
+                found += mounts.is_file(query);
+            merged.push_back(timer.seconds() * 1e9 / queries.size());
+
+            Timer probeTimer;
+            for (auto& query : queries) {
+                for (auto it = readers.rbegin(); it != readers.rend(); it++) {
+                    if ((*it)->is_file(query)) {
+                        found++;
+                        break;
+                    }
+                }
+            }
+            probing.push_back(probeTimer.seconds() * 1e9 / queries.size());
+        }
+        report.add("mount", "lookup_merged", merged, "ns/op");
+        report.add("mount", "lookup_probing", probing, "ns/op");
+        sink = found;
+
+        for (size_t i = 1; i < paths.size(); i++)
+            std::filesystem::remove(paths[i]);
+    }
+
+    // Scattered load recorded once, then replayed against the archive in add order and laid out by the profile
+    void replay(const Config& config, const SyntheticTree& tree, Report& report) {
+        auto& path = mainArchive(config, tree);
+        auto order = shuffled(tree.targets.size(), config.seed);
+        order.resize(std::max<size_t>(1, order.size() * REPLAY_SHARE / 100));
+
+        AccessProfile profile;
+        {
+            FileReader reader(path);
+            reader.startRecording();
+            std::vector<char> buffer;
+            for (auto index : order)
+                reader.readFile(tree.targets[index], buffer);
+            profile = reader.stopRecording();
+        }
+        auto profilePath = archivePath(config, "replay.profile");
+        profile.save(profilePath);
+        profile.load(profilePath);  // The way a build pipeline gets it
+        std::filesystem::remove(profilePath);
+
+        auto profiled = archivePath(config, "profiled.honk");
+        writeArchive(config, tree, profiled, [&profile](FileWriter& writer) { writer.setAccessProfile(profile); });
+
+        for (auto& [name, archive] : {std::make_pair("default", path), std::make_pair("profiled", profiled)}) {
+            // Distance the disk head travels between consecutive reads, whatever the storage is
+            double distance = 0;
+            {
+                FileReader reader(archive);
+                unsigned long long previous = 0;
+                for (size_t i = 0; i < order.size(); i++) {
+                    auto offset = reader.dataOffset(tree.targets[order[i]]);
+                    if (i > 0)
+                        distance += offset > previous ? offset - previous : previous - offset;
+                    previous = offset + tree.sizes[order[i]];
+                }
+            }
+            report.add("replay", std::string(name) + "_seek_distance", distance / order.size() / MIB, "MiB/read");
+
+            for (bool cold : {false, true}) {
+                std::vector<double> samples;
+                for (unsigned int i = 0; i < config.repeat; i++) {
+                    if (cold && !dropCache(archive))
+                        break;
+                    FileReader reader(archive);
+                    std::vector<char> buffer;
+                    Timer timer;
+                    for (auto& record : profile.records())
+                        reader.readFile(record.path, buffer);
+                    samples.push_back(timer.seconds() * 1000);
+                }
+                if (!samples.empty())
+                    report.add("replay", std::string(name) + (cold ? "_cold" : "_warm"), samples, "ms");
+            }
+        }
+        std::filesystem::remove(profiled);
+    }
+}  // namespace
+
+const std::vector<Scenario>& GooseVF::Bench::scenarios() {
+    static const std::vector<Scenario> list = {
+        {"save", "FileWriter::save throughput", save},
+        {"open", "FileReader::open latency, warm and cold cache", openLatency},
+        {"open_scaling", "Open latency of 10k, 100k and 1M entry archives", openScaling},
+        {"lookup", "exists, is_file and readFile latency, exists on a flat and a deep tree", lookup},
+        {"iterate", "Full iteration over entries", iterate},
+        {"read", "Read bandwidth of all files, warm and cold cache", readBandwidth},
+        {"cache", "readFileShared of a hot set with and without the entry cache", cache},
+        {"batch", "readFiles against a readFile loop, cold cache", batch},
+        {"concurrent", "Read bandwidth of one reader shared by threads", concurrent},
+        {"copy", "Pack and extract of big stored files", copy},
+        {"alignment", "Aligned archive size and cold read bandwidth, direct I/O", alignment},
+        {"verify", "Checksum verification throughput", verify},
+        {"mount", "Lookup through MountManager against probing archives in turn", mount},
+        {"replay", "Recorded read trace replayed against default and profile-guided data layout", replay},
+    };
+    return list;
+}
@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "Bench.h"
+#include "GooseVF/Format.h"
+
+#ifndef GOOSEVF_BENCH_REVISION
+#define GOOSEVF_BENCH_REVISION "unknown"
+#endif
+
+using namespace GooseVF::Bench;
+
+namespace {
+    void usage() {
+        std::cout << "Usage: GooseVF_bench [options]\n"
+                     "  --entries N          files in the synthetic archive (10000)\n"
+                     "  --depth N            directory depth (3)\n"
+                     "  --fanout N           subdirectories per directory (8)\n"
+                     "  --sizes KIND         fixed, uniform or lognormal (lognormal)\n"
+                     "  --min-size BYTES     (256)\n"
+                     "  --median-size BYTES  size of fixed files, median of lognormal ones (16384)\n"
+                     "  --max-size BYTES     (4194304)\n"
+                     "  --content KIND       random or text (random)\n"
+                     "  --format N           archive format version (2)\n"
+                     "  --codec N            0 - stored, 1 - built-in LZ (0)\n"
+                     "  --threads N          reader threads, 0 - one per hardware thread (0)\n"
+                     "  --repeat N           samples per measurement (5)\n"
+                     "  --lookups N          queries per lookup measurement (100000)\n"
+                     "  --seed N             (1)\n"
+                     "  --scenarios A,B      run only these\n"
+                     "  --work-dir DIR       generated files go here (goosevf_bench)\n"
+                     "  --output FILE        JSON results, stdout if not set\n"
+                     "  --label TEXT         stored with results\n"
+                     "  --keep               keep generated files\n"
+                     "  --list               list scenarios\n";
+    }
+
+    unsigned long long number(const std::string& option, const std::string& value) {
+        try {
+            size_t end = 0;
+            auto result = std::stoull(value, &end);
+            if (end == value.size())
+                return result;
+        } catch (const std::exception&) {
+        }
+        throw std::runtime_error("Invalid value of " + option + ": " + value);
+    }
+
+    std::vector<std::string> split(const std::string& s) {
+        std::vector<std::string> parts;
+        std::stringstream stream(s);
+        std::string part;
+        while (std::getline(stream, part, ','))
+            parts.push_back(part);
+        return parts;
+    }
+
+    // Returns false if the program should exit without running anything
+    bool parseArguments(int argc, char** argv, Config& config) {
+        for (int i = 1; i < argc; i++) {
+            std::string option = argv[i];
+            if (option == "--help" || option == "-h") {
+                usage();
+                return false;
+            }
+            if (option == "--list") {
+                for (auto& scenario : scenarios())
+                    std::cout << scenario.name << " - " << scenario.description << "\n";
+                return false;
+            }
+            if (option == "--keep") {
+                config.keep = true;
+                continue;
+            }
+
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value of " + option);
+            std::string value = argv[++i];
+
+            if (option == "--entries")
+                config.entries = number(option, value);
+            else if (option == "--depth")
+                config.depth = number(option, value);
+            else if (option == "--fanout")
+                config.fanout = number(option, value);
+            else if (option == "--min-size")
+                config.minSize = number(option, value);
+            else if (option == "--median-size")
+                config.medianSize = number(option, value);
+            else if (option == "--max-size")
+                config.maxSize = number(option, value);
+            else if (option == "--format")
+                config.formatVersion = number(option, value);
+            else if (option == "--codec")
+                config.codec = number(option, value);
+            else if (option == "--threads")
+                config.threads = number(option, value);
+            else if (option == "--repeat")
+                config.repeat = std::max(1ULL, number(option, value));
+            else if (option == "--lookups")
+                config.lookups = std::max(1ULL, number(option, value));
+            else if (option == "--seed")
+                config.seed = number(option, value);
+            else if (option == "--scenarios")
+                config.scenarios = split(value);
+            else if (option == "--work-dir")
+                config.workDir = value;
+            else if (option == "--output")
+                config.output = value;
+            else if (option == "--label")
+                config.label = value;
+            else if (option == "--sizes" && value == "fixed")
+                config.distribution = SizeDistribution::Fixed;
+            else if (option == "--sizes" && value == "uniform")
+                config.distribution = SizeDistribution::Uniform;
+            else if (option == "--sizes" && value == "lognormal")
+                config.distribution = SizeDistribution::LogNormal;
+            else if (option == "--content" && value == "random")
+                config.content = Content::Random;
+            else if (option == "--content" && value == "text")
+                config.content = Content::Text;
+            else
+                throw std::runtime_error("Unknown option " + option + " " + value);
+        }
+
+        if (config.entries == 0)
+            throw std::runtime_error("At least one entry is required");
+        if (config.minSize > config.maxSize)
+            throw std::runtime_error("Minimum size is bigger than maximum size");
+        for (auto& name : config.scenarios) {
+            if (std::none_of(scenarios().begin(), scenarios().end(), [&](const Scenario& s) { return name == s.name; }))
+                throw std::runtime_error("Unknown scenario " + name);
+        }
+        return true;
+    }
+
+    void describe(const Config& config, Report& report) {
+        const char* distributions[] = {"fixed", "uniform", "lognormal"};
+        char timestamp[32];
+        auto now = std::time(nullptr);
+        std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+        report.setConfig("revision", GOOSEVF_BENCH_REVISION);
+        report.setConfig("label", config.label);
+        report.setConfig("timestamp", timestamp);
+        report.setConfig("hardware_threads", std::thread::hardware_concurrency());
+        report.setConfig("entries", config.entries);
+        report.setConfig("depth", config.depth);
+        report.setConfig("fanout", config.fanout);
+        report.setConfig("sizes", distributions[static_cast<int>(config.distribution)]);
+        report.setConfig("min_size", config.minSize);
+        report.setConfig("median_size", config.medianSize);
+        report.setConfig("max_size", config.maxSize);
+        report.setConfig("content", config.content == Content::Random ? "random" : "text");
+        report.setConfig("format", config.formatVersion);
+        report.setConfig("codec", config.codec);
+        report.setConfig("repeat", config.repeat);
+        report.setConfig("seed", config.seed);
+#ifdef GOOSEVF_ENABLE_STATS
+        report.setConfig("stats", "enabled");
+#else
+        report.setConfig("stats", "disabled");
+#endif
+    }
+}  // namespace
+
+int main(int argc, char** argv) {
+    Config config;
+    try {
+        if (!parseArguments(argc, argv, config))
+            return 0;
+
+        std::filesystem::create_directories(config.workDir);
+        Report report;
+        describe(config, report);
+
+        std::cerr << "Generating " << config.entries << " files..." << std::endl;
+        auto tree = generateTree(config, config.workDir + "/source");
+        std::cerr << "Source: " << tree.totalSize / (1024.0 * 1024.0) << " MiB in " << tree.directories.size() << " directories" << std::endl;
+        if (!dropCache(tree.sources.front()))
+            report.setConfig("cold_cache", "unsupported");
+
+        for (auto& scenario : scenarios()) {
+            if (!config.scenarios.empty() && std::find(config.scenarios.begin(), config.scenarios.end(), scenario.name) == config.scenarios.end())
+                continue;
+            std::cerr << "Running " << scenario.name << "..." << std::endl;
+            scenario.run(config, tree, report);
+        }
+
+        report.print(std::cerr);
+        if (config.output.empty()) {
+            report.write(std::cout);
+        } else {
+            std::ofstream out(config.output);
+            report.write(out);
+            if (!out)
+                throw std::runtime_error("Unable to write " + config.output);
+        }
+
+        if (!config.keep)
+            std::filesystem::remove_all(config.workDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
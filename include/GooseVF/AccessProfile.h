@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace GooseVF {
+    struct AccessRecord {
+        std::string path;
+        unsigned long long time;  // Nanoseconds since recording started
+    };
+
+    // Entries in the order they were first read, recorded by FileReader and used by FileWriter to lay out data.
+    // Saved as text, one "<time> <path>" line per entry
+    class AccessProfile {
+       public:
+        void add(const std::string& path, unsigned long long time);
+        const std::vector<AccessRecord>& records() const;
+        bool empty() const;
+
+        void save(const std::string& path) const;
+        void load(const std::string& path);
+
+       private:
+        std::vector<AccessRecord> _records;
+    };
+}  // namespace GooseVF
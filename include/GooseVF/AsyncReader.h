@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GooseVF/FileReader.h"
+
+#define READ_PRIORITY_COUNT 3
+
+namespace GooseVF {
+    enum class ReadPriority {
+        Urgent,     // Needed right now, taken before anything else
+        Normal,
+        Background  // Prefetches and other speculative reads
+    };
+
+    struct ReadQueueStats {
+        size_t queued = 0;
+        size_t running = 0;
+        unsigned long long completed = 0;  // Including failed requests
+        unsigned long long cancelled = 0;
+
+        // Sums over completed requests, divide by `completed` to get averages
+        std::chrono::nanoseconds waitTime{0};  // From submission until a worker took it
+        std::chrono::nanoseconds latency{0};   // From submission until completion
+        std::chrono::nanoseconds maxLatency{0};
+    };
+
+    // Runs reads of a FileReader on a fixed pool of worker threads, higher priority requests first.
+    // The reader must outlive the scheduler
+    class AsyncReader {
+       public:
+        using RequestId = unsigned long long;
+        using Callback = std::function<void(std::vector<char> data, std::exception_ptr error)>;  // Called on a worker thread
+
+        AsyncReader(const FileReader& reader, unsigned int threads = 0);  // 0 - one per hardware thread
+        AsyncReader(const AsyncReader&) = delete;
+        AsyncReader& operator=(const AsyncReader&) = delete;
+        ~AsyncReader();  // Cancels queued requests and waits for running ones
+
+        RequestId readFileAsync(const std::string& path, ReadPriority priority, Callback callback);
+        std::future<std::vector<char>> readFileAsync(const std::string& path, ReadPriority priority = ReadPriority::Normal, RequestId* id = nullptr);
+        RequestId prefetch(const std::vector<std::string>& paths);  // Background priority
+
+        // Only requests still waiting in the queue can be cancelled, their callbacks get an error
+        bool cancel(RequestId id);
+
+        ReadQueueStats stats(ReadPriority priority) const;
+
+       private:
+        struct Request {
+            RequestId id;
+            std::vector<std::string> paths;
+            bool prefetch;
+            Callback callback;
+            std::chrono::steady_clock::time_point submitted;
+        };
+
+        const FileReader& _reader;
+        std::vector<std::thread> _threads;
+
+        std::deque<Request> _queues[READ_PRIORITY_COUNT];
+        ReadQueueStats _stats[READ_PRIORITY_COUNT];
+        mutable std::mutex _mutex;
+        std::condition_variable _condition;
+        RequestId _nextId = 1;
+        bool _stopped = false;
+
+        RequestId submit(Request request, ReadPriority priority);
+        void work();
+    };
+}  // namespace GooseVF
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+namespace GooseVF {
+    // CRC32C (Castagnoli). Uses SSE4.2 or ARMv8 CRC instructions when the CPU has them.
+    // Can be chained by passing previous result: crc32c(b, crc32c(a)) == crc32c(a + b)
+    unsigned int crc32c(const char* data, size_t size, unsigned int crc = 0);
+
+    // Checksum of a + b from checksums of both parts and size of b
+    unsigned int crc32cCombine(unsigned int first, unsigned int second, unsigned long long secondSize);
+}  // namespace GooseVF
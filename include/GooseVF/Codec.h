@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#define CODEC_STORED 0  // Data is kept as is, no codec object needed
+#define CODEC_LZ 1      // Built-in byte-oriented LZ77 codec
+
+#define DEFAULT_CHUNK_SIZE 65536
+
+namespace GooseVF {
+    // Codecs work on independent chunks and must be stateless: the reader calls them from many threads
+    class Codec {
+       public:
+        virtual ~Codec() = default;
+
+        virtual int id() const = 0;
+
+        // Returns compressed size, or 0 if result doesn't fit into dstCapacity
+        virtual size_t compress(const char* src, size_t srcSize, char* dst, size_t dstCapacity) const = 0;
+
+        // dstSize is the exact decompressed size, throws if data is malformed
+        virtual void decompress(const char* src, size_t srcSize, char* dst, size_t dstSize) const = 0;
+    };
+
+    class LzCodec : public Codec {
+       public:
+        int id() const override;
+        size_t compress(const char* src, size_t srcSize, char* dst, size_t dstCapacity) const override;
+        void decompress(const char* src, size_t srcSize, char* dst, size_t dstSize) const override;
+    };
+
+    // Ids are stored in one byte, CODEC_STORED can't be replaced
+    void registerCodec(std::shared_ptr<Codec> codec);
+    std::shared_ptr<Codec> getCodec(int id);
+}  // namespace GooseVF
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace GooseVF {
+    // Buffers stay valid while they are referenced, even after being evicted
+    using SharedBuffer = std::shared_ptr<const std::vector<char>>;
+
+    struct CacheStats {
+        unsigned long long hits = 0;
+        unsigned long long misses = 0;
+        unsigned long long evictions = 0;
+        unsigned long long size = 0;  // Bytes held by the cache
+        unsigned long long entries = 0;
+    };
+
+    // Least recently used entries are evicted once the byte budget is exceeded. Keys are split between
+    // shards with their own lock and a part of the budget, so concurrent readers rarely wait for each other.
+    // Buffers bigger than the budget of one shard are not cached
+    class EntryCache {
+       public:
+        EntryCache(unsigned long long capacity);
+
+        unsigned long long capacity() const;
+        SharedBuffer find(unsigned int key);  // Counts a hit or a miss
+        SharedBuffer insert(unsigned int key, SharedBuffer buffer);  // Returns the buffer already cached by another thread if there is one
+        void clear();
+        CacheStats stats() const;
+
+       private:
+        struct Shard {
+            mutable std::mutex mutex;
+            std::list<std::pair<unsigned int, SharedBuffer>> order;  // Most recently used first
+            std::unordered_map<unsigned int, std::list<std::pair<unsigned int, SharedBuffer>>::iterator> entries;
+            unsigned long long size = 0;
+            unsigned long long hits = 0;
+            unsigned long long misses = 0;
+            unsigned long long evictions = 0;
+        };
+
+        unsigned long long _capacity;
+        unsigned long long _shardCapacity;
+        std::vector<Shard> _shards;
+
+        Shard& shard(unsigned int key);
+    };
+}  // namespace GooseVF
@@ -1,61 +1,387 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <functional>
-#include <map>
+#include <istream>
+#include <iterator>
 #include <memory>
+#include <mutex>
+#include <streambuf>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "GooseVF/AccessProfile.h"
+#include "GooseVF/Codec.h"
+#include "GooseVF/EntryCache.h"
+#include "GooseVF/Format.h"
+#include "GooseVF/MappedFile.h"
+#include "GooseVF/RandomAccessFile.h"
+#include "GooseVF/Stats.h"
+
 namespace GooseVF {
+    class FileView {
+       public:
+        FileView() = default;
+        FileView(const char* data, size_t size) : _data(data), _size(size) {}
+
+        const char* data() const { return _data; }
+        size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+
+        const char* begin() const { return _data; }
+        const char* end() const { return _data + _size; }
+        char operator[](size_t index) const { return _data[index]; }
+
+       private:
+        const char* _data = nullptr;
+        size_t _size = 0;
+    };
+
+    enum class OpenMode {
+        Stream,  // Entries are read from the file stream on every request
+        Mapped,  // Whole archive is memory-mapped, entries can be accessed without copying
+        Lazy     // Like Stream, but directories of version 4 and newer archives are loaded on first access instead of in open()
+    };
+
+    // Whole-entry reads (readFile, readFiles, readFileView) compare data with the entry checksum and throw on
+    // mismatch. Ranged reads, streams and extractFile are not verified, use verifyAll for them
+    enum class VerifyMode {
+        Never,
+        FirstRead,  // Every entry is verified once, later reads trust it
+        Always
+    };
+
+    enum class EntryFilter {
+        All,
+        Files,
+        Directories
+    };
+
     class FileReader {
+        friend class FileWriter;    // Loads the entry tree when an archive is opened for update
+        friend class MountManager;  // Merges path indices of mounted archives and reads their entries directly
+
        public:
+        // Lightweight handle to an entry, path is only built when requested
+        class Entry {
+           public:
+            std::string_view name() const;
+            std::string path() const;  // Relative to the directory iteration started from
+            std::string fullPath() const;
+
+            bool is_file() const;
+            bool is_dir() const;
+            unsigned long long size() const;
+            int depth() const;
+
+           private:
+            friend class FileReader;
+
+            const FileReader* _reader = nullptr;
+            unsigned int _node = 0;
+            unsigned int _base = 0;
+            int _depth = 0;
+        };
+
+        // Depth-first traversal: every directory is followed by its contents
+        class EntryIterator {
+           public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = Entry;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const Entry*;
+            using reference = const Entry&;
+
+            EntryIterator() = default;
+
+            reference operator*() const { return _entry; }
+            pointer operator->() const { return &_entry; }
+            EntryIterator& operator++();
+            EntryIterator operator++(int);
+
+            bool operator==(const EntryIterator& other) const { return _entry._node == other._entry._node; }
+            bool operator!=(const EntryIterator& other) const { return !(*this == other); }
+
+           private:
+            friend class FileReader;
+
+            Entry _entry;
+            int _maxDepth = -1;
+            EntryFilter _filter = EntryFilter::All;
+
+            void advance();
+            bool accepted() const;
+        };
+
+        class EntryRange {
+           public:
+            EntryIterator begin() const;
+            EntryIterator end() const;
+
+           private:
+            friend class FileReader;
+
+            const FileReader* _reader = nullptr;
+            unsigned int _base = 0;
+            int _depth = -1;
+            EntryFilter _filter = EntryFilter::All;
+        };
+
+        // Reads one entry incrementally, keeping a single block (or compressed chunk) in memory
+        class EntryStreamBuffer : public std::streambuf {
+           public:
+            EntryStreamBuffer(const FileReader& reader, std::string_view path);
+
+           protected:
+            int_type underflow() override;
+            std::streamsize xsgetn(char* s, std::streamsize count) override;
+            std::streamsize showmanyc() override;
+            pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+            pos_type seekpos(pos_type position, std::ios_base::openmode which) override;
+
+           private:
+            const FileReader* _reader;
+            unsigned int _node;
+            unsigned long long _bufferPosition = 0;  // Entry position of the buffer beginning
+            std::vector<char> _buffer;
+#ifdef GOOSEVF_ENABLE_STATS
+            std::string _path;  // Reported to the trace hook
+#endif
+
+            unsigned long long position() const;
+            void reset(unsigned long long position);
+        };
+
+        // The reader must outlive the stream
+        class EntryStream : public std::istream {
+           public:
+            EntryStream(const FileReader& reader, std::string_view path);
+
+           private:
+            EntryStreamBuffer _buffer;
+        };
+
         FileReader();
-        FileReader(const std::string& path);
+        FileReader(const std::string& path, OpenMode mode = OpenMode::Stream);
+
+        void open(const std::string& path, OpenMode mode = OpenMode::Stream);
+
+        // Entry tree is never modified after open(), so every method below
+        // is safe to call concurrently from many threads. In lazy mode directories are loaded under a lock
+
+        int contentVersion() const;
+        void setVerifyMode(VerifyMode mode);  // Never by default, not to be changed while other threads read
 
-        void open(const std::string& path);
+        // Checks every entry with a checksum on a few threads, returns paths of corrupted ones
+        std::vector<std::string> verifyAll(unsigned int threads = 0) const;
 
-        int contentVersion();
-        void readFile(const std::string& path, std::vector<char>& output);
+        // Contents of entries read by readFile and readFileShared are kept up to this many bytes, 0 (default) turns the cache off.
+        // Clears the cache, not to be changed while other threads read
+        void setCacheSize(unsigned long long bytes);
+        CacheStats cacheStats() const;
 
-        void iterateFiles(const std::function<void(const std::string& path)> callback, const std::string& basePath = "./", int depth = -1);
-        void iterateDirectories(const std::function<void(const std::string& path)> callback, const std::string& basePath = "./", int depth = -1);
-        void iterateEntries(const std::function<void(const std::string& path, bool is_directory)> callback, const std::string& basePath = "./", int depth = -1);
+        void readFile(std::string_view path, std::vector<char>& output) const;
+        SharedBuffer readFileShared(std::string_view path) const;  // Cached buffer without copying it, a new one if there's no cache
+        void readFiles(const std::vector<std::string>& paths, std::vector<std::vector<char>>& outputs) const;  // Reads in data order, merging nearby entries
+        void prefetch(const std::vector<std::string>& paths) const;                                           // Asks the OS to start loading entries, unknown paths are ignored
+        FileView readFileView(std::string_view path) const;
+        void extractFile(std::string_view path, const std::string& outputPath) const;  // Stored entries are copied by the kernel
 
-        bool exists(const std::string& path);
-        bool is_file(const std::string& path);
-        bool is_dir(const std::string& path);
+        // Position of the entry data in the archive file. Data of compressed entries starts with the chunk table
+        unsigned long long dataOffset(std::string_view path) const;
+        bool isAligned(std::string_view path, unsigned long long alignment) const;  // Whether data can be read with direct I/O using this block size
+
+        // Reads up to size bytes starting at offset within the entry, returns amount of bytes read
+        size_t readFileRange(std::string_view path, unsigned long long offset, char* output, size_t size) const;
+
+        EntryRange entries(std::string_view basePath = "./", int depth = -1, EntryFilter filter = EntryFilter::All) const;
+        EntryRange files(std::string_view basePath = "./", int depth = -1) const;
+        EntryRange directories(std::string_view basePath = "./", int depth = -1) const;
+
+        void iterateFiles(const std::function<void(const std::string& path)> callback, std::string_view basePath = "./", int depth = -1) const;
+        void iterateDirectories(const std::function<void(const std::string& path)> callback, std::string_view basePath = "./", int depth = -1) const;
+        void iterateEntries(const std::function<void(const std::string& path, bool is_directory)> callback, std::string_view basePath = "./", int depth = -1) const;
+
+        bool exists(std::string_view path) const;
+        bool is_file(std::string_view path) const;
+        bool is_dir(std::string_view path) const;
+
+        // Counted only when built with GOOSEVF_ENABLE_STATS, otherwise stats are empty and the hook is never called.
+        // Entries of readFiles report the duration of the whole batch
+        ReaderStats stats() const;
+        void resetStats();
+        // Both are not to be changed while other threads read
+        void setStatsDepth(unsigned int depth);  // Directory levels stats are grouped by, 1 by default. Resets stats
+        void setTraceHook(TraceHook hook);       // Called on the reading thread after every read, so possibly from many threads at once
+
+        // Records files in the order they are first read (or their data offset is asked for), for FileWriter::setAccessProfile.
+        // Neither is to be called while other threads read
+        void startRecording();
+        AccessProfile stopRecording();
 
        private:
-        struct FileTreeNode {
+        static constexpr unsigned int NO_NODE = NO_ENTRY;
+
+        using FileTreeNode = IndexEntry;
+
+        // Intermediate representation of the entry table used only while opening
+        struct RawEntry {
             int id;
-            std::string name;
+            unsigned int name;
+            unsigned int nameLength;
             int type;
 
             unsigned long long offset;
-            int size;
+            unsigned long long size;
 
-            FileTreeNode* parent;
-            std::vector<int> children;
-            std::vector<FileTreeNode*> children_nodes;
+            unsigned int firstChildId;  // Index in EntryTable::childIds
+            unsigned int childCount;
         };
 
-        std::vector<FileTreeNode*> _root;
-        std::map<int, std::unique_ptr<FileTreeNode>> _nodes;
-        std::ifstream _file;
+        struct NameSlot {
+            unsigned long long hash;
+            unsigned int name;
+            unsigned int nameLength;
+        };
+
+#ifdef GOOSEVF_ENABLE_STATS
+        struct PrefixCounters {
+            std::atomic<unsigned long long> lookups;
+            std::atomic<unsigned long long> misses;
+            std::atomic<unsigned long long> reads;
+            std::atomic<unsigned long long> bytesRead;
+            std::array<std::atomic<unsigned long long>, LatencyHistogram::BUCKETS> lookupLatency;
+            std::array<std::atomic<unsigned long long>, LatencyHistogram::BUCKETS> readLatency;
+        };
+
+        struct StatsTable {
+            std::unique_ptr<unsigned int[]> prefixOf;  // Slot of every loaded node
+            std::vector<unsigned int> prefixNodes;  // Directory of every slot, NO_NODE for the root
+            std::vector<std::atomic<PrefixCounters*>> counters;  // Allocated on first use, so idle directories cost nothing
+
+            ~StatsTable();
+        };
+#endif
+
+        struct AccessRecorder {
+            std::mutex mutex;
+            std::chrono::steady_clock::time_point start;
+            std::vector<char> seen;  // Per node, only the first read is recorded
+            std::vector<std::pair<unsigned int, unsigned long long>> accesses;  // Node and time
+        };
+
+        struct EntryTable {
+            std::vector<RawEntry> entries;
+            std::vector<int> childIds;
+
+            std::vector<NameSlot> nameSlots;  // Open addressing set used to intern names
+            size_t nameCount = 0;
+            std::string nameBuffer;
+        };
+
+        // Node table, names and path index point either into owned storage or straight into the mapping
+        const FileTreeNode* _nodes = nullptr;
+        unsigned int _nodeCount = 0;
+        unsigned int _rootCount = 0;
+        std::string_view _names;
+        const IndexSlot* _index = nullptr;  // Open addressing table keyed by full path hash
+        size_t _indexCapacity = 0;
+
+        std::vector<FileTreeNode> _nodeStorage;
+        std::string _nameStorage;
+        std::vector<IndexSlot> _indexStorage;
+        std::vector<unsigned long long> _indexBlock;  // Frozen index loaded from stream, kept 8-byte aligned
+
+        // Lazy index: nodes and names are filled in directory by directory, a directory is loaded once
+        bool _lazy = false;
+        std::unique_ptr<FileTreeNode[]> _lazyNodes;
+        std::unique_ptr<char[]> _lazyNames;
+        std::unique_ptr<std::atomic<unsigned char>[]> _nodeState;
+        mutable unsigned long long _namesUsed = 0;
+        unsigned long long _indexBegin = 0;
+        unsigned long long _indexEnd = 0;
+        unsigned int _lazyEntrySize = 0;
+        mutable std::mutex _loadMutex;
+        // Codecs are taken from the registry once per reader, reads don't lock it
+        mutable std::array<std::atomic<const Codec*>, 256> _codecs{};
+        mutable std::vector<std::shared_ptr<Codec>> _codecOwners;
+        mutable std::mutex _codecMutex;
+        bool _opened = false;
+        RandomAccessFile _source;
+        MappedFile _mapping;
+        OpenMode _mode = OpenMode::Stream;
+        VerifyMode _verifyMode = VerifyMode::Never;
+        mutable std::vector<std::atomic<bool>> _verified;  // Entries that passed verification, used in FirstRead mode
+        std::unique_ptr<EntryCache> _cache;  // Keyed by node
+        std::unique_ptr<AccessRecorder> _recorder;
         int _fileVersion;
         int _contentVersion;
         unsigned long long _fileSectionBegin;
+#ifdef GOOSEVF_ENABLE_STATS
+        unsigned long long _openTime = 0;
+        unsigned int _statsDepth = 1;
+        std::unique_ptr<StatsTable> _stats;
+        TraceHook _traceHook;
+#endif
+
+        void readHeader(std::istream& in);
+        void readEntryTable(std::istream& in, EntryTable& table);
+        void readEntry(std::istream& in, EntryTable& table);
+        unsigned int internName(EntryTable& table, const std::string& name);
+        void buildEntryTree(EntryTable& table);
+        void buildIndex();
+        void readFrozenIndex(std::istream& in);
+        void readTrailingIndex(std::istream& in);
+        void locateIndex(std::istream& in, unsigned long long& offset, unsigned long long& size);  // Trailing and newer
+        void loadIndexBlock(std::istream& in, unsigned long long begin, unsigned long long size);
+        void useFrozenIndex(const char* block, unsigned long long size);
+        void validateNodeTable() const;
+        void validateEntry(unsigned int i) const;
+        void readLazyIndex(std::istream& in);
+        const char* indexData(unsigned long long offset, unsigned long long size, std::vector<char>& buffer) const;
+        void loadBlock(unsigned int dir, const char* block, unsigned long long size) const;
+        void loadDirectory(unsigned int dir) const;  // Children of the directory, does nothing if they are already loaded
+        void loadAllDirectories() const;
+        void loadAll();  // Turns a lazy reader into a regular one with a path index
+        bool isPresent(unsigned int node) const;
+        bool isLoaded(unsigned int node) const;
+        void readMetadata(std::istream& in);
+
+        std::string_view nodeName(const FileTreeNode* node) const;
+        std::string buildPath(unsigned int node, unsigned int base = NO_NODE) const;
+        unsigned int childrenEnd(unsigned int parent) const;
 
-        void readHeader();
-        void readEntryTable();
-        void readEntry();
-        void buildEntryTree();
-        void readMetadata();
+        FileView readRawData(unsigned long long offset, unsigned long long size, std::vector<char>& buffer) const;
+        void readEntryData(const FileTreeNode* node, unsigned long long position, char* output, size_t size) const;
+        size_t readEntryRange(const FileTreeNode* node, unsigned long long offset, char* output, size_t size) const;  // Clamped to the entry end
+        FileView viewEntry(const FileTreeNode* node) const;
+        void loadEntry(const FileTreeNode* node, std::vector<char>& output) const;  // Whole entry, through the cache if there is one
+        SharedBuffer sharedEntry(const FileTreeNode* node) const;
+        void decodeEntry(const FileTreeNode* node, const char* data, char* output) const;  // Whole entry from its stored data
+        void verifyEntry(const FileTreeNode* node, const char* data) const;  // Whole entry, according to verify mode
+        void decodeChunks(const FileTreeNode* node, const unsigned int* table, const char* src, unsigned long long position, char* output, size_t size) const;
+        const Codec* codecOf(unsigned char id) const;
 
-        std::string buildPath(FileTreeNode* node);
-        std::string buildPath(FileTreeNode* node, const std::vector<std::string>& skip);
+        const FileTreeNode* getNode(std::string_view path) const;
+        const FileTreeNode* getFileNode(std::string_view path) const;
+        const FileTreeNode* findNode(std::string_view path, int type) const;
+        void recordAccess(const FileTreeNode* node) const;
+        bool matchesPath(const FileTreeNode* node, std::string_view path) const;
+        const FileTreeNode* walkPath(std::string_view path, int type) const;  // Lookup of lazy readers, loads directories on the way
+        unsigned int findChild(unsigned int dir, std::string_view name) const;   // Children of lazy indices are sorted by name
 
-        FileTreeNode* getNode(const std::string& path);
+#ifdef GOOSEVF_ENABLE_STATS
+        static unsigned long long statsClock();  // Nanoseconds
+        void buildStatsTable();
+        void assignPrefixes(unsigned int dir) const;  // Slots of the children of a loaded directory
+        PrefixCounters& prefixCounters(unsigned int slot) const;
+        unsigned int missedPrefix(std::string_view path) const;  // Slot of the nearest existing directory
+        void recordLookup(const FileTreeNode* node, std::string_view path, unsigned long long start) const;
+        void recordRead(const FileTreeNode* node, std::string_view path, unsigned long long offset, unsigned long long size, unsigned long long start) const;
+#endif
     };
 }  // namespace GooseVF
@@ -1,16 +1,54 @@
 #pragma once
 
+#include <condition_variable>
+#include <exception>
 #include <fstream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "GooseVF/AccessProfile.h"
+#include "GooseVF/Codec.h"
+#include "GooseVF/OutputFile.h"
+
 namespace GooseVF {
     class FileWriter {
        public:
         void setFileVersion(int version);
+        void setFormatVersion(int version);
+        void setCompression(int codec, unsigned int chunkSize = DEFAULT_CHUNK_SIZE);  // Default codec for added files
+        void setThreadCount(unsigned int threads);                                    // 0 - one per hardware thread
+        void setDeduplication(bool enabled);                                          // Files with identical contents share their data
+        void setAlignment(unsigned int alignment, unsigned long long minSize = 0);   // Data of files of at least minSize bytes starts at a multiple of alignment in the archive
+        void setChecksums(bool enabled);                                              // CRC32C of every file, format version 2 or newer. Enabled by default
+        void setAccessProfile(const AccessProfile& profile);                          // Data of profiled files comes first, in the order they were read
+
+        void addFile(const std::string& path, const std::string& targetPath, int codec);
         void addFile(const std::string& path, const std::string& targetPath);
         void addFile(const std::string& path);
+        void addBuffer(std::vector<char> data, const std::string& targetPath, int codec);
+        void addBuffer(std::vector<char> data, const std::string& targetPath);
+        // Stream is read to the end by the next save or update and must stay valid until then. Its size doesn't have
+        // to be known, such files are never deduplicated
+        void addStream(std::shared_ptr<std::istream> stream, const std::string& targetPath, int codec);
+        void addStream(std::shared_ptr<std::istream> stream, const std::string& targetPath);
         void save(const std::string& path);
+        // Writes data and then the index in one pass, without seeking, so pipes and sockets work too.
+        // Requires FORMAT_VERSION_STREAMED, files are copied through the stream instead of by the kernel
+        void save(std::ostream& out);
+
+        // Loads entries of an existing archive of any version. Files added afterwards replace entries with the
+        // same path, update() appends their data and a new index to the archive without copying the rest.
+        // Older archives are converted to FORMAT_VERSION_TRAILING, content version is increased by one unless set.
+        // Until update() is done, an archive of FORMAT_VERSION_TRAILING or newer keeps pointing at its previous
+        // index. Older ones have their entry table right after the header, an interrupted conversion loses it
+        void openForUpdate(const std::string& path);
+        void update();
 
        private:
         struct EntryData {
@@ -19,28 +57,108 @@ namespace GooseVF {
             int type = -1;
 
             unsigned long long offset = -1;
-            int size = -1;
+            unsigned long long size = 0;
+
+            int codec = -1;  // Requested codec, writer default if negative
+            int storedCodec = CODEC_STORED;
+            int chunkShift = 0;
+            unsigned long long storedSize = 0;
+            unsigned int checksum = 0;
+            bool hasChecksum = false;
+            bool trailingTable = false;  // Chunk table follows the chunks
 
             std::string originalPath;
+            std::shared_ptr<const std::vector<char>> buffer;  // Contents added from memory
+            std::shared_ptr<std::istream> stream;             // Contents read while saving
+            bool streamRead = false;
+            bool inArchive = false;  // Data is already in the archive opened for update
             std::vector<EntryData> children;
         };
 
+        // Input file shared by the jobs of one file, opened by the first of them and closed after the last
+        struct DataSource {
+            std::mutex mutex;
+            RandomAccessFile file;
+            size_t pendingJobs = 0;
+        };
+
+        struct DataJob {
+            const EntryData* file;
+            DataSource* source;  // nullptr if contents are in memory
+            const Codec* codec;  // nullptr if data is stored as is
+            unsigned long long position;
+            unsigned long long size;
+            bool checksum;  // Checksum of the original data is computed
+            bool copied;    // Data is copied by the kernel later, job only computes the checksum
+        };
+
+        struct DataResult {
+            std::vector<char> data;
+            bool compressed = false;
+            unsigned int checksum = 0;
+            bool ready = false;
+            std::exception_ptr error;
+        };
+
+        // Hands jobs out to worker threads, keeping at most `window` finished results in memory
+        class DataPipeline {
+           public:
+            DataPipeline(const std::vector<DataJob>& jobs, size_t window);
+
+            void work();
+            DataResult take(size_t job);
+            unsigned long long jobSize(size_t job) const;
+            void stop();
+
+           private:
+            const std::vector<DataJob>& _jobs;
+            std::vector<DataResult> _results;
+            std::mutex _mutex;
+            std::condition_variable _condition;
+            size_t _claimed = 0;
+            size_t _taken = 0;
+            bool _stopped = false;
+
+            void process(const DataJob& job, DataResult& result);
+        };
+
         std::vector<EntryData> _data;
-        std::vector<std::string> _files;
+        std::vector<int> _files;  // Ids of file entries in the order their data is written
+        std::unordered_map<std::string, size_t> _filePaths;  // Lower case target path -> index among its parent's children
+        std::unordered_set<std::string> _dirPaths;           // Lower case paths of directories
 
         int _fileVersion = 0;
+        int _formatVersion = 0;
+        int _codec = CODEC_STORED;
+        int _chunkShift = 16;
+        unsigned int _threadCount = 0;
+        bool _deduplicate = false;
+        bool _checksums = true;
+        unsigned int _alignment = 1;
+        unsigned long long _alignmentMinSize = 0;
         int _idCounter = 0;
-        unsigned long long _fileOffsetCounter = 0;
+        unsigned long long _fileSectionBegin = 0;
+        std::string _updatePath;
+        int _archiveVersion = 0;  // Format version in the header of the archive opened for update
+        std::vector<std::string> _profile;  // Lower case target paths in the order they were read
 
         EntryData* createDirectories(const std::vector<std::string>& path);
-        void createFile(const std::string& filename, const std::string& realPath, std::vector<EntryData>& parentArray);
+        EntryData& createFile(const std::string& targetPath, int codec);  // Source is set by the caller
+        void collectEntries(std::vector<EntryData*>& entries);
 
-        void writeEntryTable(std::ofstream& of);
-        void writeEntry(std::ofstream& of, EntryData* data);
+        void writeEntryTable(std::ostream& of);
+        void writeEntry(std::ostream& of, EntryData* data);
+        unsigned long long writeFrozenIndex(std::ostream& of, bool trailing = false);
+        unsigned long long writeTrailingIndex(std::ostream& of);
+        unsigned long long writeLazyIndex(std::ostream& of, unsigned long long indexOffset);
 
-        void writeMetadata(std::ofstream& of);
+        void writeMetadata(std::ostream& of);
 
-        void writeFilesData(std::ofstream& of);
-        void writeFileData(std::ofstream& of, const std::string& filename);
+        void orderByProfile();
+        void findDuplicates(const std::vector<EntryData*>& entries, unsigned int workers, std::vector<size_t>& duplicateOf);
+        void writeFilesData(std::ostream& of, const std::string& path);
+        void writeFileData(std::ostream& of, OutputFile& out, EntryData& file, Codec* codec, DataPipeline& pipeline, size_t firstJob, size_t lastJob);
+        void writeStreamData(std::ostream& of, EntryData& file, Codec* codec);
+        void copyFileData(std::ostream& of, OutputFile& out, const EntryData& file);
     };
 }  // namespace GooseVF
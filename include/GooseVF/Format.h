@@ -0,0 +1,102 @@
+#pragma once
+
+#define FORMAT_VERSION_LEGACY 0    // Variable-length entry table
+#define FORMAT_VERSION_METADATA 1  // Legacy entry table followed by metadata tables
+#define FORMAT_VERSION_FROZEN 2    // Fixed-width index that can be used without parsing
+#define FORMAT_VERSION_TRAILING 3  // Frozen index written after file data, updates append a new one
+#define FORMAT_VERSION_LAZY 4      // Trailing index split into directory blocks, which can be loaded on first access
+#define FORMAT_VERSION_STREAMED 5  // Lazy index found through a footer, archive is written in one pass without seeking
+
+#define FROZEN_INDEX_OFFSET 16  // Index size field is 8-byte aligned, header is padded up to it
+#define FROZEN_ENTRY_MIN_SIZE 40  // Entries were extended over time, missing trailing fields read as zero
+#define TRAILING_HEADER_SIZE 32   // Header with index offset and size, file data starts right after it
+
+#define ENTRY_FLAG_CHECKSUM 1        // IndexEntry::checksum is set
+#define ENTRY_FLAG_TRAILING_TABLE 2  // Chunk table follows the chunks
+
+namespace GooseVF {
+    constexpr unsigned int NO_ENTRY = 0xFFFFFFFF;
+
+    // Frozen index layout:
+    //   IndexHeader
+    //   IndexEntry[entryCount]  - breadth-first, children of a directory are contiguous
+    //   IndexSlot[slotCount]    - open addressing table keyed by full path hash
+    //   names blob              - padded to 8 bytes
+    //
+    // Trailing index archives keep index offset and size at FROZEN_INDEX_OFFSET, the index itself is
+    // 8-byte aligned and followed by metadata tables. Entry offsets are counted from the file beginning.
+    //
+    // Lazy index layout, at the same place as the trailing index:
+    //   LazyIndexHeader
+    //   root block
+    //   blocks of other non-empty directories, 8-byte aligned, breadth-first
+    // A block holds IndexEntry of every child of a directory, sorted by name, followed by their names.
+    // Entry names are offsets within names of their block. Directory entries point at the block of their
+    // children: offset is its position in the file, storedSize is its size.
+    //
+    // Streamed archives leave index offset and size in the header zero. StreamFooter at the very end of the file,
+    // after metadata tables, points at the index and holds the content version. Updates append a new footer.
+    //
+    // Entry checksum is CRC32C of the original (decompressed) contents.
+    //
+    // Compressed entry data starts with a table of chunk sizes (4 bytes each), followed by the chunks.
+    // Entries with ENTRY_FLAG_TRAILING_TABLE have it after the chunks, at the end of their stored data. Streamed
+    // archives write all compressed entries this way, entries of an archive converted to them stay as they are.
+    // Chunk with the size equal to its decompressed size is stored as is.
+    struct IndexHeader {
+        unsigned int entrySize;
+        unsigned int entryCount;
+        unsigned int rootCount;
+        unsigned int slotCount;
+        unsigned long long namesSize;
+    };
+
+    struct IndexEntry {
+        unsigned long long offset;  // From file section beginning
+        unsigned long long size;
+
+        unsigned int name;  // Offset in the names blob
+        unsigned int nameLength;
+        unsigned int parent;      // NO_ENTRY for root entries
+        unsigned int firstChild;  // Children occupy [firstChild, firstChild + childCount)
+        unsigned int childCount;
+
+        unsigned char type;
+        unsigned char codec;       // CODEC_STORED keeps data as is
+        unsigned char chunkShift;  // Compressed entries are split into chunks of (1 << chunkShift) bytes
+        unsigned char flags;       // ENTRY_FLAG_*
+
+        unsigned long long storedSize;  // Size in the file section, only used by compressed entries
+
+        unsigned int checksum;
+        unsigned int reserved;
+    };
+
+    struct LazyIndexHeader {
+        unsigned int entrySize;
+        unsigned int entryCount;
+        unsigned int rootCount;
+        unsigned int reserved;
+        unsigned long long namesSize;      // Names of all blocks
+        unsigned long long rootBlockSize;  // Root block follows the header
+    };
+
+    struct StreamFooter {
+        unsigned long long indexOffset;
+        unsigned long long indexSize;
+        int contentVersion;
+        char magic[4];  // HONK, tells a complete archive from a cut one
+    };
+
+    struct IndexSlot {
+        unsigned long long hash;
+        unsigned int entry;  // NO_ENTRY if slot is empty
+        unsigned int reserved;
+    };
+
+    static_assert(sizeof(IndexHeader) == 24, "Unexpected index header size");
+    static_assert(sizeof(IndexEntry) == 56, "Unexpected index entry size");
+    static_assert(sizeof(IndexSlot) == 16, "Unexpected index slot size");
+    static_assert(sizeof(LazyIndexHeader) == 32, "Unexpected lazy index header size");
+    static_assert(sizeof(StreamFooter) == 24, "Unexpected stream footer size");
+}  // namespace GooseVF
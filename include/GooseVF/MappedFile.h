@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace GooseVF {
+    class MappedFile {
+       public:
+        MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile();
+
+        void open(const std::string& path);
+        void close();
+
+        bool isOpen() const;
+        const char* data() const;
+        size_t size() const;
+
+        void advise(unsigned long long offset, unsigned long long size) const;  // Hint that the range is going to be read soon
+
+       private:
+        bool _opened = false;
+        const char* _data = nullptr;
+        size_t _size = 0;
+
+#ifdef _WIN32
+        void* _fileHandle = nullptr;
+        void* _mappingHandle = nullptr;
+#endif
+    };
+}  // namespace GooseVF
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "GooseVF/FileReader.h"
+
+namespace GooseVF {
+    // Overlays several archives: a path resolves to the entry of the highest priority archive containing it,
+    // whether it's a file or a directory. Paths of all archives share one index, so a lookup is a single
+    // hash probe regardless of how many archives are mounted.
+    //
+    // Lookups and reads are safe to call concurrently with each other and with mount() and unmount().
+    // Views returned by readFileView() stay valid until their archive is unmounted
+    class MountManager {
+       public:
+        using LayerId = unsigned int;
+
+        MountManager() = default;
+        MountManager(const MountManager&) = delete;
+        MountManager& operator=(const MountManager&) = delete;
+
+        // Higher priority archives shadow lower ones, among equal priorities the one mounted last wins
+        LayerId mount(const std::string& path, int priority = 0, OpenMode mode = OpenMode::Stream);
+        void unmount(LayerId id);
+        size_t layerCount() const;
+        void setVerifyMode(VerifyMode mode);  // Applies to mounted and later mounted archives
+        void setCacheSize(unsigned long long bytes);  // Budget of every archive's own cache, same as setVerifyMode
+
+        void readFile(std::string_view path, std::vector<char>& output) const;
+        SharedBuffer readFileShared(std::string_view path) const;
+        FileView readFileView(std::string_view path) const;
+        size_t readFileRange(std::string_view path, unsigned long long offset, char* output, size_t size) const;
+
+        // Archive the path resolves to, nullptr if there is none. Use it for operations
+        // not routed through the manager, the reader must not be used after unmount()
+        const FileReader* owner(std::string_view path) const;
+
+        bool exists(std::string_view path) const;
+        bool is_file(std::string_view path) const;
+        bool is_dir(std::string_view path) const;
+
+       private:
+        struct Layer {
+            LayerId id;
+            int priority;
+            std::unique_ptr<FileReader> reader;
+        };
+
+        // Slots with the same hash are kept in layer precedence order along the probe sequence,
+        // so the first one matching the path is the visible entry
+        struct Slot {
+            unsigned long long hash;
+            const Layer* layer;  // nullptr if slot is empty
+            unsigned int node;
+        };
+
+        std::vector<std::unique_ptr<Layer>> _layers;
+        std::vector<Slot> _slots;
+        size_t _slotCount = 0;
+        LayerId _nextId = 1;
+        VerifyMode _verifyMode = VerifyMode::Never;
+        unsigned long long _cacheSize = 0;
+        mutable std::shared_mutex _mutex;
+
+        static bool precedes(const Layer* a, const Layer* b);
+        void reserve(size_t count);
+        void insert(Slot slot);
+        void erase(unsigned long long hash, const Layer* layer, unsigned int node);
+        const Slot* find(std::string_view path) const;
+        const FileReader::FileTreeNode* findFile(std::string_view path, const FileReader*& reader) const;
+    };
+}  // namespace GooseVF
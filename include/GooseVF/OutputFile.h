@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "GooseVF/RandomAccessFile.h"
+
+namespace GooseVF {
+    class OutputFile {
+       public:
+        OutputFile();
+        OutputFile(const OutputFile&) = delete;
+        OutputFile& operator=(const OutputFile&) = delete;
+        ~OutputFile();
+
+        void open(const std::string& path, bool truncate = true);
+        void close();
+
+        bool isOpen() const;
+
+        void writeAt(unsigned long long offset, const char* data, size_t size);
+
+        // Copies data between files inside the kernel (copy_file_range, then sendfile),
+        // falls back to reading through a large buffer where that isn't available
+        void copyFrom(const RandomAccessFile& source, unsigned long long sourceOffset, unsigned long long offset, unsigned long long size);
+
+       private:
+#ifdef _WIN32
+        void* _handle = nullptr;
+#else
+        int _fd = -1;
+#endif
+    };
+}  // namespace GooseVF
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace GooseVF {
+    class IoRing;
+
+    struct ReadRequest {
+        unsigned long long offset;
+        char* buffer;
+        size_t size;
+    };
+
+    class RandomAccessFile {
+       public:
+        RandomAccessFile();
+        RandomAccessFile(const RandomAccessFile&) = delete;
+        RandomAccessFile& operator=(const RandomAccessFile&) = delete;
+        ~RandomAccessFile();
+
+        void open(const std::string& path);
+        void close();
+
+        bool isOpen() const;
+        unsigned long long size() const;
+
+        // Positional read, doesn't move any shared cursor so it can be called from many threads
+        void readAt(unsigned long long offset, char* buffer, size_t size) const;
+
+        // Many reads kept in flight at once through io_uring when built with GOOSEVF_IO_URING,
+        // one by one otherwise, if the kernel doesn't allow it or if another thread is using the ring
+        void readBatch(const std::vector<ReadRequest>& requests) const;
+
+        void advise(unsigned long long offset, unsigned long long size) const;  // Hint that the range is going to be read soon
+
+       private:
+        friend class OutputFile;  // Kernel-side copies need the native handle
+
+        unsigned long long _size = 0;
+
+        mutable std::unique_ptr<IoRing> _ring;  // Set up on the first batch, kept until close()
+        mutable std::mutex _ringMutex;
+
+#ifdef _WIN32
+        void* _handle = nullptr;
+#else
+        int _fd = -1;
+#endif
+    };
+}  // namespace GooseVF
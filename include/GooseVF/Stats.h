@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace GooseVF {
+    // Bucket i holds durations from 2^(i-1) to 2^i nanoseconds, the last one everything longer
+    struct LatencyHistogram {
+        static constexpr size_t BUCKETS = 32;
+
+        std::array<unsigned long long, BUCKETS> counts{};
+
+        unsigned long long count() const;
+        unsigned long long percentile(double fraction) const;  // Upper bound of the bucket holding it, in nanoseconds
+        void add(const LatencyHistogram& other);
+    };
+
+    struct PrefixStats {
+        std::string prefix;  // Directory path, empty for entries lying in the archive root
+        unsigned long long lookups = 0;
+        unsigned long long misses = 0;
+        unsigned long long reads = 0;
+        unsigned long long bytesRead = 0;
+        LatencyHistogram lookupLatency;
+        LatencyHistogram readLatency;
+    };
+
+    struct ReaderStats {
+        unsigned long long openTime = 0;  // Nanoseconds
+        unsigned long long lookups = 0;
+        unsigned long long misses = 0;
+        unsigned long long reads = 0;
+        unsigned long long bytesRead = 0;
+        LatencyHistogram lookupLatency;
+        LatencyHistogram readLatency;
+        std::vector<PrefixStats> prefixes;  // Only prefixes that were accessed
+    };
+
+    struct ReadEvent {
+        std::string_view path;  // As passed by the caller
+        unsigned long long offset;  // Within the entry
+        unsigned long long size;
+        unsigned long long duration;  // Nanoseconds
+    };
+
+    using TraceHook = std::function<void(const ReadEvent& event)>;
+}  // namespace GooseVF
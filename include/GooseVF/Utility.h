@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #define ENTRYDATA_TYPE_FILE 0
@@ -8,6 +11,40 @@
 #define BYTE unsigned char
 
 namespace GooseVF {
-    std::vector<std::string> splitPath(const std::string& s);
+    // Names are matched case-insensitively: folding is applied to both stored names and queries
+    inline char foldCase(char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    // Splits a path into names without allocating, from either end. Both '\\' and '/' separate names,
+    // empty names and "." are skipped. Names are views into the path and keep their case
+    class PathTokenizer {
+       public:
+        explicit PathTokenizer(std::string_view path) : _path(path) {}
+
+        bool next(std::string_view& name);
+        bool nextFromEnd(std::string_view& name);
+        bool empty() const;  // Whether any name is left
+
+       private:
+        std::string_view _path;
+    };
+
+    std::vector<std::string> splitPath(std::string_view s);  // Names as PathTokenizer sees them
     std::string buildPath(const std::vector<std::string>& s);
+    bool equalsFolded(std::string_view stored, std::string_view name);  // Stored name against a name of a query, both folded
+    int compareFolded(std::string_view stored, std::string_view name);  // Same, in the order of folded names (unsigned bytes)
+
+    // FNV-1a, can be chained by passing previous result as seed
+    unsigned long long hashString(std::string_view s, unsigned long long seed = 14695981039346656037ULL);
+    unsigned long long hashFolded(std::string_view s, unsigned long long seed = 14695981039346656037ULL);  // hashString of the folded string
+    unsigned long long hashPath(const std::vector<std::string>& parts);
+    // Equals hashPath of the case folded names of the path, no allocations. Stops after maxNames names, returns their count
+    size_t hashPath(std::string_view path, unsigned long long& hash, size_t maxNames = SIZE_MAX);
+
+    // Fast non-cryptographic hash of file contents, 8 bytes per step. Chained the same way as hashString
+    unsigned long long hashData(const char* data, size_t size, unsigned long long seed = 0);
+
+    // Runs task(i) for every i in [0, count) on a few threads, rethrows the first failure
+    void parallelFor(size_t count, unsigned int threads, const std::function<void(size_t)>& task);
 }  // namespace GooseVF
\ No newline at end of file
@@ -0,0 +1,49 @@
+#include "GooseVF/AccessProfile.h"
+
+#include <fstream>
+#include <stdexcept>
+
+using namespace GooseVF;
+
+void AccessProfile::add(const std::string& path, unsigned long long time) {
+    _records.push_back(AccessRecord{path, time});
+}
+
+const std::vector<AccessRecord>& AccessProfile::records() const {
+    return _records;
+}
+
+bool AccessProfile::empty() const {
+    return _records.empty();
+}
+
+void AccessProfile::save(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out.is_open())
+        throw std::runtime_error("Unable to create file");
+
+    for (auto& record : _records) {
+        out << record.time << ' ' << record.path << '\n';
+    }
+    if (!out)
+        throw std::runtime_error("Unable to write file");
+}
+
+void AccessProfile::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open())
+        throw std::runtime_error("File not found");
+
+    // Paths may contain spaces, only the first one separates the time
+    std::vector<AccessRecord> records;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty())
+            continue;
+        auto separator = line.find(' ');
+        if (separator == 0 || separator == std::string::npos || line.find_first_not_of("0123456789") != separator)
+            throw std::runtime_error("Invalid access profile");
+        records.push_back(AccessRecord{line.substr(separator + 1), std::stoull(line.substr(0, separator))});
+    }
+    _records = std::move(records);
+}
@@ -0,0 +1,172 @@
+#include "GooseVF/AsyncReader.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace GooseVF;
+
+namespace {
+    std::exception_ptr cancelledError() {
+        return std::make_exception_ptr(std::runtime_error("Request was cancelled"));
+    }
+
+    void complete(const AsyncReader::Callback& callback, std::vector<char> data, std::exception_ptr error) {
+        if (!callback)
+            return;
+        try {
+            callback(std::move(data), error);
+        } catch (...) {
+            // Nothing to report it to on a worker thread
+        }
+    }
+}  // namespace
+
+AsyncReader::AsyncReader(const FileReader& reader, unsigned int threads)
+    : _reader(reader) {
+    auto workers = threads > 0 ? threads : std::max(1U, std::thread::hardware_concurrency());
+    for (unsigned int i = 0; i < workers; i++) {
+        _threads.emplace_back([this]() { work(); });
+    }
+}
+
+AsyncReader::~AsyncReader() {
+    std::vector<Request> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+        for (int priority = 0; priority < READ_PRIORITY_COUNT; priority++) {
+            _stats[priority].cancelled += _queues[priority].size();
+            _stats[priority].queued = 0;
+            for (auto& request : _queues[priority]) {
+                cancelled.push_back(std::move(request));
+            }
+            _queues[priority].clear();
+        }
+    }
+    _condition.notify_all();
+
+    for (auto& thread : _threads) {
+        thread.join();
+    }
+    for (auto& request : cancelled) {
+        complete(request.callback, {}, cancelledError());
+    }
+}
+
+AsyncReader::RequestId AsyncReader::readFileAsync(const std::string& path, ReadPriority priority, Callback callback) {
+    return submit(Request{0, {path}, false, std::move(callback), {}}, priority);
+}
+
+std::future<std::vector<char>> AsyncReader::readFileAsync(const std::string& path, ReadPriority priority, RequestId* id) {
+    auto promise = std::make_shared<std::promise<std::vector<char>>>();
+    auto future = promise->get_future();
+
+    auto requestId = readFileAsync(path, priority, [promise](std::vector<char> data, std::exception_ptr error) {
+        if (error)
+            promise->set_exception(error);
+        else
+            promise->set_value(std::move(data));
+    });
+    if (id != nullptr)
+        *id = requestId;
+    return future;
+}
+
+AsyncReader::RequestId AsyncReader::prefetch(const std::vector<std::string>& paths) {
+    return submit(Request{0, paths, true, nullptr, {}}, ReadPriority::Background);
+}
+
+bool AsyncReader::cancel(RequestId id) {
+    Request request;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        bool found = false;
+        for (int priority = 0; priority < READ_PRIORITY_COUNT && !found; priority++) {
+            auto& queue = _queues[priority];
+            auto it = std::find_if(queue.begin(), queue.end(), [id](const Request& r) { return r.id == id; });
+            if (it == queue.end())
+                continue;
+
+            request = std::move(*it);
+            queue.erase(it);
+            _stats[priority].queued--;
+            _stats[priority].cancelled++;
+            found = true;
+        }
+        if (!found)
+            return false;
+    }
+
+    complete(request.callback, {}, cancelledError());
+    return true;
+}
+
+ReadQueueStats AsyncReader::stats(ReadPriority priority) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats[static_cast<int>(priority)];
+}
+
+AsyncReader::RequestId AsyncReader::submit(Request request, ReadPriority priority) {
+    RequestId id;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stopped)
+            throw std::runtime_error("Reader is stopped");
+
+        id = _nextId++;
+        request.id = id;
+        request.submitted = std::chrono::steady_clock::now();
+        _queues[static_cast<int>(priority)].push_back(std::move(request));
+        _stats[static_cast<int>(priority)].queued++;
+    }
+    _condition.notify_one();
+    return id;
+}
+
+void AsyncReader::work() {
+    while (true) {
+        Request request;
+        int priority = 0;
+        std::chrono::steady_clock::time_point started;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this]() {
+                return _stopped || std::any_of(std::begin(_queues), std::end(_queues), [](const std::deque<Request>& queue) { return !queue.empty(); });
+            });
+            if (_stopped)
+                return;
+
+            while (_queues[priority].empty())
+                priority++;
+            request = std::move(_queues[priority].front());
+            _queues[priority].pop_front();
+
+            started = std::chrono::steady_clock::now();
+            _stats[priority].queued--;
+            _stats[priority].running++;
+            _stats[priority].waitTime += started - request.submitted;
+        }
+
+        std::vector<char> data;
+        std::exception_ptr error;
+        try {
+            if (request.prefetch)
+                _reader.prefetch(request.paths);
+            else
+                _reader.readFile(request.paths[0], data);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        complete(request.callback, std::move(data), error);
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto latency = std::chrono::steady_clock::now() - request.submitted;
+            auto& stats = _stats[priority];
+            stats.running--;
+            stats.completed++;
+            stats.latency += latency;
+            stats.maxLatency = std::max<std::chrono::nanoseconds>(stats.maxLatency, latency);
+        }
+    }
+}
@@ -0,0 +1,170 @@
+#include "GooseVF/Checksum.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC32C_X86
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define CRC32C_ARM
+#include <arm_acle.h>
+#endif
+
+#define CRC32C_POLY 0x82F63B78U  // Reversed Castagnoli polynomial
+#define CRC32C_STRIPE 8192       // Bytes per lane when three lanes run interleaved
+
+using namespace GooseVF;
+
+namespace {
+    struct Tables {
+        unsigned int slice[8][256];  // Slicing-by-8 tables for the portable path
+        unsigned int power[64];      // x^(2^n) mod P, used to shift a checksum over zeros
+
+        Tables() {
+            for (unsigned int i = 0; i < 256; i++) {
+                auto crc = i;
+                for (int bit = 0; bit < 8; bit++)
+                    crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+                slice[0][i] = crc;
+            }
+            for (unsigned int i = 0; i < 256; i++) {
+                for (int k = 1; k < 8; k++)
+                    slice[k][i] = (slice[k - 1][i] >> 8) ^ slice[0][slice[k - 1][i] & 0xFF];
+            }
+
+            power[0] = 1U << 30;  // x^1
+            for (int n = 1; n < 64; n++)
+                power[n] = multiply(power[n - 1], power[n - 1]);
+        }
+
+        // Product of two polynomials modulo P, both in reflected bit order
+        static unsigned int multiply(unsigned int a, unsigned int b) {
+            unsigned int product = 0;
+            for (unsigned int mask = 1U << 31; mask != 0; mask >>= 1) {
+                if (a & mask)
+                    product ^= b;
+                b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+            }
+            return product;
+        }
+
+        // x^(8 * bytes) mod P
+        unsigned int shift(unsigned long long bytes) const {
+            unsigned int result = 1U << 31;  // x^0
+            for (int n = 3; bytes != 0; bytes >>= 1, n++) {
+                if (bytes & 1)
+                    result = multiply(power[n & 63], result);
+            }
+            return result;
+        }
+    };
+
+    const Tables& tables() {
+        static const Tables instance;
+        return instance;
+    }
+
+    unsigned int updatePortable(unsigned int crc, const unsigned char* data, size_t size) {
+        auto& t = tables().slice;
+        for (; size >= 8; size -= 8, data += 8) {
+            unsigned int low, high;
+            std::memcpy(&low, data, 4);
+            std::memcpy(&high, data + 4, 4);
+            low ^= crc;
+            crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+                  t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        }
+        for (; size > 0; size--, data++)
+            crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+        return crc;
+    }
+
+#if defined(CRC32C_X86) || defined(CRC32C_ARM)
+#if defined(CRC32C_X86) && !defined(_MSC_VER)
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#else
+#define CRC32C_TARGET
+#endif
+
+    CRC32C_TARGET inline unsigned int step(unsigned int crc, unsigned long long word) {
+#ifdef CRC32C_X86
+        return static_cast<unsigned int>(_mm_crc32_u64(crc, word));
+#else
+        return __crc32cd(crc, word);
+#endif
+    }
+
+    CRC32C_TARGET inline unsigned int step(unsigned int crc, unsigned char byte) {
+#ifdef CRC32C_X86
+        return _mm_crc32_u8(crc, byte);
+#else
+        return __crc32cb(crc, byte);
+#endif
+    }
+
+    // Instruction has a latency of several cycles but can start every cycle, so long inputs
+    // are split into three independent lanes whose results are merged by shifting
+    CRC32C_TARGET unsigned int updateHardware(unsigned int crc, const unsigned char* data, size_t size) {
+        unsigned long long word;
+        if (size >= 3 * CRC32C_STRIPE) {
+            static const unsigned int laneShift = tables().shift(CRC32C_STRIPE);
+            do {
+                unsigned int crc1 = 0, crc2 = 0;
+                for (size_t i = 0; i < CRC32C_STRIPE; i += 8) {
+                    std::memcpy(&word, data + i, 8);
+                    crc = step(crc, word);
+                    std::memcpy(&word, data + CRC32C_STRIPE + i, 8);
+                    crc1 = step(crc1, word);
+                    std::memcpy(&word, data + 2 * CRC32C_STRIPE + i, 8);
+                    crc2 = step(crc2, word);
+                }
+                crc = Tables::multiply(laneShift, Tables::multiply(laneShift, crc) ^ crc1) ^ crc2;
+                data += 3 * CRC32C_STRIPE;
+                size -= 3 * CRC32C_STRIPE;
+            } while (size >= 3 * CRC32C_STRIPE);
+        }
+
+        for (; size >= 8; size -= 8, data += 8) {
+            std::memcpy(&word, data, 8);
+            crc = step(crc, word);
+        }
+        for (; size > 0; size--, data++)
+            crc = step(crc, *data);
+        return crc;
+    }
+
+    bool hasHardware() {
+#if defined(CRC32C_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#elif defined(CRC32C_X86)
+        return __builtin_cpu_supports("sse4.2");
+#else
+        return true;  // Compiled for a CPU with the CRC extension
+#endif
+    }
+#endif
+
+    using Update = unsigned int (*)(unsigned int, const unsigned char*, size_t);
+
+    Update selectUpdate() {
+#if defined(CRC32C_X86) || defined(CRC32C_ARM)
+        if (hasHardware())
+            return updateHardware;
+#endif
+        return updatePortable;
+    }
+}  // namespace
+
+unsigned int GooseVF::crc32c(const char* data, size_t size, unsigned int crc) {
+    static const Update update = selectUpdate();
+    return ~update(~crc, reinterpret_cast<const unsigned char*>(data), size);
+}
+
+unsigned int GooseVF::crc32cCombine(unsigned int first, unsigned int second, unsigned long long secondSize) {
+    return Tables::multiply(tables().shift(secondSize), first) ^ second;
+}
@@ -0,0 +1,178 @@
+#include "GooseVF/Codec.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+using namespace GooseVF;
+
+// LZ block format: a sequence of [token][literal length+][literals][offset:2][match length+]
+// Token keeps literal length in high nibble and (match length - 4) in low nibble, value 15 means
+// length continues in the following bytes (each 255 adds up, first byte below 255 ends it).
+// The last sequence has literals only and ends right with the input.
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+
+namespace {
+    std::mutex registryMutex;
+    std::array<std::shared_ptr<Codec>, 256> registry = {nullptr, std::make_shared<LzCodec>()};
+
+    bool writeLength(char* dst, size_t& op, size_t capacity, size_t length) {
+        while (length >= 255) {
+            if (op >= capacity)
+                return false;
+            dst[op++] = static_cast<char>(255);
+            length -= 255;
+        }
+        if (op >= capacity)
+            return false;
+        dst[op++] = static_cast<char>(length);
+        return true;
+    }
+
+    bool writeSequence(char* dst, size_t& op, size_t capacity, const char* literals, size_t literalLength, size_t offset, size_t matchLength) {
+        auto literalToken = literalLength < 15 ? literalLength : 15;
+        auto matchToken = 0;
+        if (matchLength > 0)
+            matchToken = (matchLength - LZ_MIN_MATCH) < 15 ? (matchLength - LZ_MIN_MATCH) : 15;
+
+        if (op >= capacity)
+            return false;
+        dst[op++] = static_cast<char>((literalToken << 4) | matchToken);
+        if (literalToken == 15 && !writeLength(dst, op, capacity, literalLength - 15))
+            return false;
+
+        if (op + literalLength > capacity)
+            return false;
+        std::memcpy(dst + op, literals, literalLength);
+        op += literalLength;
+
+        if (matchLength == 0)
+            return true;
+
+        if (op + 2 > capacity)
+            return false;
+        dst[op++] = static_cast<char>(offset & 0xFF);
+        dst[op++] = static_cast<char>(offset >> 8);
+        if (matchToken == 15 && !writeLength(dst, op, capacity, matchLength - LZ_MIN_MATCH - 15))
+            return false;
+        return true;
+    }
+
+    size_t readLength(const unsigned char* src, size_t& ip, size_t srcSize) {
+        size_t length = 0;
+        unsigned char byte;
+        do {
+            if (ip >= srcSize)
+                throw std::runtime_error("Compressed data is corrupted");
+            byte = src[ip++];
+            length += byte;
+        } while (byte == 255);
+        return length;
+    }
+}  // namespace
+
+int LzCodec::id() const {
+    return CODEC_LZ;
+}
+
+size_t LzCodec::compress(const char* src, size_t srcSize, char* dst, size_t dstCapacity) const {
+    if (srcSize == 0)
+        return 0;
+
+    std::vector<uint32_t> table(1 << LZ_HASH_BITS, 0);  // Position + 1 of the last sequence with this hash
+    size_t ip = 0;
+    size_t anchor = 0;
+    size_t op = 0;
+
+    while (ip + LZ_MIN_MATCH <= srcSize) {
+        uint32_t sequence;
+        std::memcpy(&sequence, src + ip, 4);
+        auto hash = (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+        auto candidate = table[hash];
+        table[hash] = static_cast<uint32_t>(ip + 1);
+
+        if (candidate == 0 || ip - (candidate - 1) > LZ_MAX_OFFSET || std::memcmp(src + candidate - 1, src + ip, 4) != 0) {
+            ip++;
+            continue;
+        }
+
+        size_t ref = candidate - 1;
+        size_t length = LZ_MIN_MATCH;
+        while (ip + length < srcSize && src[ref + length] == src[ip + length])
+            length++;
+
+        if (!writeSequence(dst, op, dstCapacity, src + anchor, ip - anchor, ip - ref, length))
+            return 0;
+        ip += length;
+        anchor = ip;
+    }
+
+    if (anchor < srcSize && !writeSequence(dst, op, dstCapacity, src + anchor, srcSize - anchor, 0, 0))
+        return 0;
+    return op;
+}
+
+void LzCodec::decompress(const char* src, size_t srcSize, char* dst, size_t dstSize) const {
+    auto* in = reinterpret_cast<const unsigned char*>(src);
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < srcSize) {
+        auto token = in[ip++];
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15)
+            literalLength += readLength(in, ip, srcSize);
+        if (literalLength > srcSize - ip || literalLength > dstSize - op)
+            throw std::runtime_error("Compressed data is corrupted");
+        std::memcpy(dst + op, src + ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+
+        if (ip == srcSize)
+            break;  // Last sequence has no match
+
+        if (srcSize - ip < 2)
+            throw std::runtime_error("Compressed data is corrupted");
+        size_t offset = in[ip] | (in[ip + 1] << 8);
+        ip += 2;
+
+        size_t matchLength = (token & 0x0F);
+        if (matchLength == 15)
+            matchLength += readLength(in, ip, srcSize);
+        matchLength += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > op || matchLength > dstSize - op)
+            throw std::runtime_error("Compressed data is corrupted");
+        for (size_t i = 0; i < matchLength; i++, op++) {
+            dst[op] = dst[op - offset];  // Byte by byte, match may overlap output
+        }
+    }
+
+    if (op != dstSize)
+        throw std::runtime_error("Compressed data is corrupted");
+}
+
+void GooseVF::registerCodec(std::shared_ptr<Codec> codec) {
+    if (codec == nullptr || codec->id() <= CODEC_STORED || codec->id() > 255)
+        throw std::runtime_error("Invalid codec id");
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry[codec->id()] = std::move(codec);
+}
+
+std::shared_ptr<Codec> GooseVF::getCodec(int id) {
+    if (id <= CODEC_STORED || id > 255)
+        throw std::runtime_error("Unknown codec");
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    if (registry[id] == nullptr)
+        throw std::runtime_error("Unknown codec");
+    return registry[id];
+}
@@ -0,0 +1,83 @@
+#include "GooseVF/EntryCache.h"
+
+#include <algorithm>
+
+#define CACHE_MAX_SHARDS 16
+#define CACHE_MIN_SHARD_SIZE (4 << 20)  // Small budgets use fewer shards, so bigger entries still fit
+
+using namespace GooseVF;
+
+EntryCache::EntryCache(unsigned long long capacity)
+    : _capacity(capacity),
+      _shards(std::max<unsigned long long>(1, std::min<unsigned long long>(CACHE_MAX_SHARDS, capacity / CACHE_MIN_SHARD_SIZE))) {
+    _shardCapacity = _capacity / _shards.size();
+}
+
+unsigned long long EntryCache::capacity() const {
+    return _capacity;
+}
+
+SharedBuffer EntryCache::find(unsigned int key) {
+    auto& shard = this->shard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end()) {
+        shard.misses++;
+        return nullptr;
+    }
+    shard.hits++;
+    shard.order.splice(shard.order.begin(), shard.order, it->second);
+    return it->second->second;
+}
+
+SharedBuffer EntryCache::insert(unsigned int key, SharedBuffer buffer) {
+    if (buffer->size() > _shardCapacity)
+        return buffer;
+
+    auto& shard = this->shard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end())
+        return it->second->second;
+
+    shard.order.emplace_front(key, buffer);
+    shard.entries.emplace(key, shard.order.begin());
+    shard.size += buffer->size();
+    while (shard.size > _shardCapacity) {
+        auto& last = shard.order.back();
+        shard.size -= last.second->size();
+        shard.entries.erase(last.first);
+        shard.order.pop_back();
+        shard.evictions++;
+    }
+    return buffer;
+}
+
+void EntryCache::clear() {
+    for (auto& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.order.clear();
+        shard.entries.clear();
+        shard.size = 0;
+    }
+}
+
+CacheStats EntryCache::stats() const {
+    CacheStats result;
+    for (auto& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        result.hits += shard.hits;
+        result.misses += shard.misses;
+        result.evictions += shard.evictions;
+        result.size += shard.size;
+        result.entries += shard.entries.size();
+    }
+    return result;
+}
+
+EntryCache::Shard& EntryCache::shard(unsigned int key) {
+    // Fibonacci hashing, neighbouring entries land in different shards
+    return _shards[((key * 2654435769U) >> 16) % _shards.size()];
+}
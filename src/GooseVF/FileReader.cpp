@@ -1,364 +1,1787 @@
 #include "GooseVF/FileReader.h"
 
-#include <filesystem>
-#include <queue>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
 
+#include "GooseVF/Checksum.h"
+#include "GooseVF/Codec.h"
+#include "GooseVF/OutputFile.h"
 #include "GooseVF/Utility.h"
 
+#define EXTRACT_BLOCK_SIZE (4 << 20)
+#define BATCH_READ_GAP 65536       // Entries closer than this are read together, gap is read and dropped
+#define BATCH_MAX_READ (16 << 20)  // Limit for merged reads, single entries may still be bigger
+#define STREAM_BLOCK_SIZE 65536  // Buffer of entry streams, compressed entries use their chunk size if it's bigger
+#define STATS_MAX_PREFIXES 65536  // Deeper directories share the slot of their parent once there are this many
+
+// Node states of lazy readers
+#define NODE_PRESENT 1  // Entry was read from the block of its parent
+#define NODE_LOADED 2   // Children of the directory are present
+
+// Instrumentation compiles to nothing without GOOSEVF_ENABLE_STATS
+#ifdef GOOSEVF_ENABLE_STATS
+#define STATS_START(name) auto name = statsClock()
+#define STATS_LOOKUP(node, path, start) recordLookup(node, path, start)
+#define STATS_READ(node, path, offset, size, start) recordRead(node, path, offset, size, start)
+#else
+#define STATS_START(name)
+#define STATS_LOOKUP(node, path, start)
+#define STATS_READ(node, path, offset, size, start)
+#endif
+
 using namespace GooseVF;
 
+#ifdef GOOSEVF_ENABLE_STATS
+namespace {
+    size_t latencyBucket(unsigned long long nanoseconds) {
+        size_t bucket = 0;
+        while (nanoseconds > 0 && bucket < LatencyHistogram::BUCKETS - 1) {
+            nanoseconds >>= 1;
+            bucket++;
+        }
+        return bucket;
+    }
+}  // namespace
+#endif
+
 FileReader::FileReader() {
 }
 
-FileReader::FileReader(const std::string& path) {
-    open(path);
+FileReader::FileReader(const std::string& path, OpenMode mode) {
+    open(path, mode);
 }
 
-void FileReader::open(const std::string& path) {
-    _file.open(path, std::ios::binary);
-    if (!_file.is_open())
+void FileReader::open(const std::string& path, OpenMode mode) {
+    STATS_START(start);
+    _opened = false;
+    _nodes = nullptr;
+    _nodeCount = 0;
+    _rootCount = 0;
+    _names = std::string_view();
+    _index = nullptr;
+    _indexCapacity = 0;
+    _nodeStorage.clear();
+    _nameStorage.clear();
+    _indexStorage.clear();
+    _indexBlock.clear();
+    _lazy = false;
+    _lazyNodes.reset();
+    _lazyNames.reset();
+    _nodeState.reset();
+    _namesUsed = 0;
+    _source.close();
+    _mapping.close();
+#ifdef GOOSEVF_ENABLE_STATS
+    _stats.reset();
+#endif
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
         throw std::runtime_error("File not found");
 
-    readHeader();
-    readEntryTable();
-    buildEntryTree();
+    _mode = mode;
+    if (_mode == OpenMode::Mapped)
+        _mapping.open(path);
+    _source.open(path);  // Also used by extractFile() in mapped mode
+
+    readHeader(file);
+    if (_fileVersion >= FORMAT_VERSION_LAZY) {
+        readLazyIndex(file);
+    } else if (_fileVersion >= FORMAT_VERSION_TRAILING) {
+        readTrailingIndex(file);
+    } else if (_fileVersion >= FORMAT_VERSION_FROZEN) {
+        readFrozenIndex(file);
+    } else {
+        EntryTable table;
+        readEntryTable(file, table);
+        buildEntryTree(table);
+        buildIndex();
+    }
     if (_fileVersion > 0)
-        readMetadata();
+        readMetadata(file);
+    if (!file)
+        throw std::runtime_error("File is corrupted. Header is truncated.");
 
-    _fileSectionBegin = _file.tellg();
+    _fileSectionBegin = (_fileVersion >= FORMAT_VERSION_TRAILING) ? 0 : (unsigned long long)file.tellg();
+    _verified = std::vector<std::atomic<bool>>(_nodeCount);
+    if (_cache)
+        _cache->clear();
+    _recorder.reset();
+    file.close();
+#ifdef GOOSEVF_ENABLE_STATS
+    buildStatsTable();
+    _openTime = statsClock() - start;
+#endif
+    _opened = true;
 }
 
-int FileReader::contentVersion() {
-    if (!_file.is_open())
+int FileReader::contentVersion() const {
+    if (!_opened)
         throw std::runtime_error("File is not opened");
     return _contentVersion;
 }
 
-void FileReader::readFile(const std::string& path, std::vector<char>& output) {
-    if (!_file.is_open())
+void FileReader::setVerifyMode(VerifyMode mode) {
+    _verifyMode = mode;
+}
+
+void FileReader::setCacheSize(unsigned long long bytes) {
+    if (bytes == 0)
+        _cache.reset();
+    else
+        _cache = std::make_unique<EntryCache>(bytes);
+}
+
+CacheStats FileReader::cacheStats() const {
+    return _cache ? _cache->stats() : CacheStats();
+}
+
+std::vector<std::string> FileReader::verifyAll(unsigned int threads) const {
+    if (!_opened)
         throw std::runtime_error("File is not opened");
 
-    auto parts = splitPath(path);
-    if (parts[0] == ".")
-        parts.erase(parts.begin());
+    loadAllDirectories();
 
-    if (!parts.size())
-        throw std::runtime_error("File not found.");
+    // Data section order, entries sharing data are checked once
+    std::vector<const FileTreeNode*> nodes;
+    for (unsigned int i = 0; i < _nodeCount; i++) {
+        if (isPresent(i) && _nodes[i].type == ENTRYDATA_TYPE_FILE && (_nodes[i].flags & ENTRY_FLAG_CHECKSUM))
+            nodes.push_back(&_nodes[i]);
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const FileTreeNode* a, const FileTreeNode* b) {
+        return a->offset < b->offset || (a->offset == b->offset && a->size < b->size);
+    });
+
+    std::vector<size_t> owner(nodes.size());  // Entry that is actually checked for this one
+    std::vector<size_t> unique;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        bool same = i > 0 && nodes[i]->offset == nodes[i - 1]->offset && nodes[i]->size == nodes[i - 1]->size && nodes[i]->checksum == nodes[i - 1]->checksum;
+        if (!same)
+            unique.push_back(i);
+        owner[i] = same ? owner[i - 1] : i;
+    }
+
+    std::vector<char> corrupted(nodes.size(), 0);
+    auto workers = threads > 0 ? threads : std::max(1U, std::thread::hardware_concurrency());
+    parallelFor(unique.size(), workers, [&](size_t i) {
+        auto* node = nodes[unique[i]];
+        unsigned int checksum = 0;
+        try {
+            if (_mode == OpenMode::Mapped && node->codec == CODEC_STORED) {
+                std::vector<char> unused;
+                auto view = readRawData(node->offset, node->size, unused);
+                checksum = crc32c(view.data(), view.size());
+            } else {
+                // Bounded memory for big entries, blocks hold whole chunks so every chunk is decoded once
+                unsigned long long blockSize = std::max<unsigned long long>(EXTRACT_BLOCK_SIZE, 1ULL << node->chunkShift);
+                std::vector<char> buffer(std::min(blockSize, node->size));
+                for (unsigned long long position = 0; position < node->size; position += blockSize) {
+                    auto size = std::min(blockSize, node->size - position);
+                    readEntryData(node, position, buffer.data(), size);
+                    checksum = crc32c(buffer.data(), size, checksum);
+                }
+            }
+        } catch (const std::exception&) {
+            checksum = ~node->checksum;  // Unreadable data is reported like a mismatch
+        }
+        corrupted[unique[i]] = checksum != node->checksum;
+        if (!corrupted[unique[i]])
+            _verified[node - _nodes] = true;
+    });
+
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (corrupted[owner[i]])
+            paths.push_back(buildPath(nodes[i] - _nodes));
+    }
+    return paths;
+}
+
+ReaderStats FileReader::stats() const {
+    ReaderStats result;
+#ifdef GOOSEVF_ENABLE_STATS
+    result.openTime = _openTime;
+    if (!_stats)
+        return result;
 
-    FileTreeNode* node = nullptr;
-    std::vector<FileTreeNode*>* arr = &_root;
-    for (size_t i = 0; i < parts.size(); i++) {
-        auto& name = parts[i];
-        auto expectedType = (i < (parts.size() - 1)) ? ENTRYDATA_TYPE_DIR : ENTRYDATA_TYPE_FILE;
-
-        auto it = std::find_if(arr->begin(), arr->end(),
-                               [&name, &expectedType](FileTreeNode* n) {
-                                   return (!n->name.compare(name)) && (n->type == expectedType);
-                               });
-        if (it == arr->end()) {
-            throw std::runtime_error("File not found.");
+    std::lock_guard<std::mutex> lock(_loadMutex);  // Lazy loads add slots
+    for (size_t slot = 0; slot < _stats->prefixNodes.size(); slot++) {
+        auto* counters = _stats->counters[slot].load(std::memory_order_acquire);
+        if (counters == nullptr)
+            continue;
+
+        PrefixStats prefix;
+        prefix.prefix = (slot == 0) ? std::string() : buildPath(_stats->prefixNodes[slot]);
+        prefix.lookups = counters->lookups.load(std::memory_order_relaxed);
+        prefix.misses = counters->misses.load(std::memory_order_relaxed);
+        prefix.reads = counters->reads.load(std::memory_order_relaxed);
+        prefix.bytesRead = counters->bytesRead.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < LatencyHistogram::BUCKETS; i++) {
+            prefix.lookupLatency.counts[i] = counters->lookupLatency[i].load(std::memory_order_relaxed);
+            prefix.readLatency.counts[i] = counters->readLatency[i].load(std::memory_order_relaxed);
         }
-        node = *it;
-        arr = &node->children_nodes;
+        if (prefix.lookups == 0 && prefix.reads == 0)
+            continue;
+
+        result.lookups += prefix.lookups;
+        result.misses += prefix.misses;
+        result.reads += prefix.reads;
+        result.bytesRead += prefix.bytesRead;
+        result.lookupLatency.add(prefix.lookupLatency);
+        result.readLatency.add(prefix.readLatency);
+        result.prefixes.push_back(std::move(prefix));
+    }
+#endif
+    return result;
+}
+
+void FileReader::resetStats() {
+#ifdef GOOSEVF_ENABLE_STATS
+    if (!_stats)
+        return;
+
+    // Counters stay allocated, so threads reading meanwhile never see them freed
+    for (auto& slot : _stats->counters) {
+        auto* counters = slot.load(std::memory_order_acquire);
+        if (counters == nullptr)
+            continue;
+        counters->lookups = 0;
+        counters->misses = 0;
+        counters->reads = 0;
+        counters->bytesRead = 0;
+        for (size_t i = 0; i < LatencyHistogram::BUCKETS; i++) {
+            counters->lookupLatency[i] = 0;
+            counters->readLatency[i] = 0;
+        }
+    }
+#endif
+}
+
+void FileReader::setStatsDepth(unsigned int depth) {
+#ifdef GOOSEVF_ENABLE_STATS
+    _statsDepth = depth;
+    if (_opened)
+        buildStatsTable();
+#else
+    (void)depth;
+#endif
+}
+
+void FileReader::setTraceHook(TraceHook hook) {
+#ifdef GOOSEVF_ENABLE_STATS
+    _traceHook = std::move(hook);
+#else
+    (void)hook;
+#endif
+}
+
+void FileReader::startRecording() {
+    _recorder = std::make_unique<AccessRecorder>();
+    _recorder->start = std::chrono::steady_clock::now();
+    _recorder->seen.resize(_nodeCount);
+}
+
+AccessProfile FileReader::stopRecording() {
+    AccessProfile profile;
+    if (!_recorder)
+        return profile;
+
+    // Paths are only built now, recording a read costs no more than a lock
+    for (auto& [node, time] : _recorder->accesses) {
+        profile.add(buildPath(node), time);
+    }
+    _recorder.reset();
+    return profile;
+}
+
+void FileReader::readFile(std::string_view path, std::vector<char>& output) const {
+    if (!_opened)
+        throw std::runtime_error("File is not opened");
+
+    auto* node = getFileNode(path);
+    STATS_START(start);
+    loadEntry(node, output);
+    STATS_READ(node, path, 0, node->size, start);
+}
+
+SharedBuffer FileReader::readFileShared(std::string_view path) const {
+    if (!_opened)
+        throw std::runtime_error("File is not opened");
+
+    auto* node = getFileNode(path);
+    STATS_START(start);
+    auto buffer = sharedEntry(node);
+    STATS_READ(node, path, 0, node->size, start);
+    return buffer;
+}
+
+void FileReader::loadEntry(const FileTreeNode* node, std::vector<char>& output) const {
+    if (_cache) {
+        auto buffer = sharedEntry(node);
+        output.assign(buffer->begin(), buffer->end());
+        return;
     }
 
     output.resize(node->size);
-    _file.seekg(_fileSectionBegin + node->offset);
-    _file.read(output.data(), node->size);
+    readEntryData(node, 0, output.data(), node->size);
+    verifyEntry(node, output.data());
+}
+
+SharedBuffer FileReader::sharedEntry(const FileTreeNode* node) const {
+    unsigned int key = node - _nodes;
+    if (_cache) {
+        auto cached = _cache->find(key);
+        if (cached)
+            return cached;
+    }
+
+    auto buffer = std::make_shared<std::vector<char>>(node->size);
+    readEntryData(node, 0, buffer->data(), node->size);
+    verifyEntry(node, buffer->data());
+    if (_cache)
+        return _cache->insert(key, std::move(buffer));
+    return buffer;
+}
+
+FileView FileReader::readFileView(std::string_view path) const {
+    if (!_opened)
+        throw std::runtime_error("File is not opened");
+
+    auto* node = getFileNode(path);
+    STATS_START(start);
+    auto view = viewEntry(node);
+    STATS_READ(node, path, 0, view.size(), start);
+    return view;
 }
 
-void FileReader::iterateFiles(const std::function<void(const std::string&)> callback, const std::string& basePath, int depth) {
-    if (!_file.is_open())
+FileView FileReader::viewEntry(const FileTreeNode* node) const {
+    if (_mode != OpenMode::Mapped)
+        throw std::runtime_error("File is not opened in mapped mode");
+    if (node->codec != CODEC_STORED)
+        throw std::runtime_error("Entry is compressed and can't be viewed in place");
+
+    std::vector<char> unused;
+    auto view = readRawData(node->offset, node->size, unused);
+    verifyEntry(node, view.data());
+    return view;
+}
+
+void FileReader::extractFile(std::string_view path, const std::string& outputPath) const {
+    if (!_opened)
         throw std::runtime_error("File is not opened");
-    iterateEntries(
-        [&callback](const std::string& path, bool is_directory) {
-            if (is_directory)
-                return;
-            callback(path);
-        },
-        basePath,
-        depth);
-}
-
-void FileReader::iterateDirectories(const std::function<void(const std::string& path)> callback, const std::string& basePath, int depth) {
-    if (!_file.is_open())
+
+    auto* node = getFileNode(path);
+    STATS_START(start);
+    OutputFile out;
+    out.open(outputPath);
+    if (node->codec == CODEC_STORED) {
+        out.copyFrom(_source, _fileSectionBegin + node->offset, 0, node->size);
+        STATS_READ(node, path, 0, node->size, start);
+        return;
+    }
+
+    // Decompressed in blocks of whole chunks, so every chunk is decoded once
+    unsigned long long blockSize = std::max<unsigned long long>(EXTRACT_BLOCK_SIZE, 1ULL << node->chunkShift);
+    std::vector<char> buffer(std::min(blockSize, node->size));
+    for (unsigned long long position = 0; position < node->size; position += blockSize) {
+        auto size = std::min(blockSize, node->size - position);
+        readEntryData(node, position, buffer.data(), size);
+        out.writeAt(position, buffer.data(), size);
+    }
+    STATS_READ(node, path, 0, node->size, start);
+}
+
+unsigned long long FileReader::dataOffset(std::string_view path) const {
+    if (!_opened)
+        throw std::runtime_error("File is not opened");
+    return _fileSectionBegin + getFileNode(path)->offset;
+}
+
+bool FileReader::isAligned(std::string_view path, unsigned long long alignment) const {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+        throw std::runtime_error("Alignment must be a power of two");
+    return dataOffset(path) % alignment == 0;
+}
+
+size_t FileReader::readFileRange(std::string_view path, unsigned long long offset, char* output, size_t size) const {
+    if (!_opened)
         throw std::runtime_error("File is not opened");
-    iterateEntries(
-        [&callback](const std::string& path, bool is_directory) {
-            if (!is_directory)
-                return;
-            callback(path);
-        },
-        basePath,
-        depth);
-}
-
-void FileReader::iterateEntries(const std::function<void(const std::string& path, bool is_directory)> callback, const std::string& basePath, int depth) {
-    if (!_file.is_open())
+
+    auto* node = getFileNode(path);
+    STATS_START(start);
+    auto done = readEntryRange(node, offset, output, size);
+    STATS_READ(node, path, offset, done, start);
+    return done;
+}
+
+size_t FileReader::readEntryRange(const FileTreeNode* node, unsigned long long offset, char* output, size_t size) const {
+    if (offset > node->size)
+        throw std::runtime_error("Read is out of entry bounds");
+
+    size = std::min<unsigned long long>(size, node->size - offset);
+    readEntryData(node, offset, output, size);
+    return size;
+}
+
+void FileReader::readFiles(const std::vector<std::string>& paths, std::vector<std::vector<char>>& outputs) const {
+    if (!_opened)
         throw std::runtime_error("File is not opened");
 
-    auto parts = splitPath(basePath);
-    if (parts[0] == ".")
-        parts.erase(parts.begin());
-    auto parentNode = getNode(basePath);
+    struct Request {
+        const FileTreeNode* node;
+        size_t output;
+        unsigned long long storedSize;
+    };
 
-    std::vector<int> visited;
-    std::queue<std::pair<FileTreeNode*, int>> q;
-    auto& arr = (parentNode == nullptr) ? _root : parentNode->children_nodes;
+    std::vector<Request> requests;
+    requests.reserve(paths.size());
+    outputs.resize(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        auto* node = getFileNode(paths[i]);
+        outputs[i].resize(node->size);
+        auto storedSize = (node->codec == CODEC_STORED) ? node->size : node->storedSize;
+        if (node->size > 0)
+            requests.push_back(Request{node, i, storedSize});
+    }
+
+    // Data section order turns the batch into a mostly sequential pass over the archive
+    std::sort(requests.begin(), requests.end(), [](const Request& a, const Request& b) {
+        return a.node->offset < b.node->offset;
+    });
 
-    for (auto& node : arr) {
-        q.emplace(std::make_pair(node, 0));
+    STATS_START(start);
+    if (_mode == OpenMode::Mapped) {
+        for (auto& request : requests) {
+            readEntryData(request.node, 0, outputs[request.output].data(), request.node->size);
+            verifyEntry(request.node, outputs[request.output].data());
+        }
+#ifdef GOOSEVF_ENABLE_STATS
+        for (auto& request : requests) {
+            STATS_READ(request.node, paths[request.output], 0, request.node->size, start);
+        }
+#endif
+        return;
     }
 
-    while (!q.empty()) {
-        auto [node, nodeDepth] = q.front();
-        q.pop();
-        visited.push_back(node->id);
-        if (depth >= 0 && nodeDepth > depth)
-            continue;
+    // Entries lying close to each other are read with a single request and scattered afterwards.
+    // A group with one stored entry is read straight into its output
+    struct Group {
+        size_t first;
+        size_t last;
+        unsigned long long begin;
+        unsigned long long end;
+        std::vector<char> buffer;
+    };
 
-        auto path = buildPath(node);
-        auto relativePath = std::filesystem::relative(path, basePath).string();
-        callback(relativePath, node->type == ENTRYDATA_TYPE_DIR);
+    std::vector<Group> groups;
+    for (size_t i = 0; i < requests.size(); i++) {
+        auto begin = requests[i].node->offset;
+        auto end = begin + requests[i].storedSize;
+        if (end < begin)
+            throw std::runtime_error("File is corrupted. Entry is out of bounds.");
 
-        for (auto& child : node->children_nodes) {
-            if (std::find(visited.begin(), visited.end(), child->id) != visited.end())
+        if (!groups.empty()) {
+            auto& group = groups.back();
+            if (begin <= group.end + BATCH_READ_GAP && std::max(end, group.end) - group.begin <= BATCH_MAX_READ) {
+                group.last = i + 1;
+                group.end = std::max(end, group.end);
                 continue;
-            q.push(std::make_pair(child, nodeDepth + 1));
+            }
         }
+        groups.push_back(Group{i, i + 1, begin, end, {}});
     }
-}
 
-bool FileReader::exists(const std::string& path) {
-    if (!_file.is_open())
-        throw std::runtime_error("File is not opened");
+    std::vector<ReadRequest> reads;
+    reads.reserve(groups.size());
+    for (auto& group : groups) {
+        auto& first = requests[group.first];
+        if (group.last - group.first == 1 && first.node->codec == CODEC_STORED) {
+            reads.push_back(ReadRequest{_fileSectionBegin + group.begin, outputs[first.output].data(), first.node->size});
+        } else {
+            group.buffer.resize(group.end - group.begin);
+            reads.push_back(ReadRequest{_fileSectionBegin + group.begin, group.buffer.data(), group.buffer.size()});
+        }
+    }
+    _source.readBatch(reads);
 
-    auto parts = splitPath(path);
-    if (parts[0] == ".")
-        parts.erase(parts.begin());
-    if (!parts.size())
-        return false;
-
-    std::vector<FileTreeNode*>* arr = &_root;
-    for (size_t i = 0; i < parts.size(); i++) {
-        auto& name = parts[i];
-        auto it = std::find_if(arr->begin(), arr->end(),
-                               [&name](FileTreeNode* n) {
-                                   return (!n->name.compare(name));
-                               });
-        if (it == arr->end()) {
-            return false;
+    for (auto& group : groups) {
+        if (group.buffer.empty())
+            continue;
+        for (auto i = group.first; i < group.last; i++) {
+            auto& request = requests[i];
+            decodeEntry(request.node, group.buffer.data() + (request.node->offset - group.begin), outputs[request.output].data());
         }
-        arr = &(*it)->children_nodes;
     }
-    return true;
+    for (auto& request : requests) {
+        verifyEntry(request.node, outputs[request.output].data());
+    }
+#ifdef GOOSEVF_ENABLE_STATS
+    for (auto& request : requests) {
+        STATS_READ(request.node, paths[request.output], 0, request.node->size, start);
+    }
+#endif
 }
 
-bool FileReader::is_file(const std::string& path) {
-    if (!_file.is_open())
+void FileReader::prefetch(const std::vector<std::string>& paths) const {
+    if (!_opened)
         throw std::runtime_error("File is not opened");
 
-    auto parts = splitPath(path);
-    if (parts[0] == ".")
-        parts.erase(parts.begin());
-    if (!parts.size())
-        return false;
-
-    std::vector<FileTreeNode*>* arr = &_root;
-    for (size_t i = 0; i < parts.size(); i++) {
-        auto& name = parts[i];
-        auto it = std::find_if(arr->begin(), arr->end(),
-                               [&name](FileTreeNode* n) {
-                                   return (!n->name.compare(name));
-                               });
-        if (it == arr->end()) {
-            return false;
-        }
-        arr = &(*it)->children_nodes;
+    for (auto& path : paths) {
+        auto* node = findNode(path, ENTRYDATA_TYPE_FILE);
+        if (node == nullptr || node->size == 0)
+            continue;
 
-        if (i == parts.size() - 1) {
-            return (*it)->type == ENTRYDATA_TYPE_FILE;
-        }
+        auto storedSize = (node->codec == CODEC_STORED) ? node->size : node->storedSize;
+        if (_mode == OpenMode::Mapped)
+            _mapping.advise(_fileSectionBegin + node->offset, storedSize);
+        else
+            _source.advise(_fileSectionBegin + node->offset, storedSize);
     }
-    return false;
 }
 
-bool FileReader::is_dir(const std::string& path) {
-    if (!_file.is_open())
+FileReader::EntryRange FileReader::entries(std::string_view basePath, int depth, EntryFilter filter) const {
+    if (!_opened)
         throw std::runtime_error("File is not opened");
-    auto parts = splitPath(path);
-    if (parts[0] == ".")
-        parts.erase(parts.begin());
-    if (!parts.size())
-        return false;
-
-    std::vector<FileTreeNode*>* arr = &_root;
-    for (size_t i = 0; i < parts.size(); i++) {
-        auto& name = parts[i];
-        auto it = std::find_if(arr->begin(), arr->end(),
-                               [&name](FileTreeNode* n) {
-                                   return (!n->name.compare(name));
-                               });
-        if (it == arr->end()) {
-            return false;
-        }
-        arr = &(*it)->children_nodes;
 
-        if (i == parts.size() - 1) {
-            return (*it)->type == ENTRYDATA_TYPE_DIR;
-        }
+    EntryRange range;
+    range._reader = this;
+    range._base = NO_NODE;
+    range._depth = depth;
+    range._filter = filter;
+
+    if (PathTokenizer(basePath).empty())
+        return range;  // Archive root
+
+    auto* node = getNode(basePath);
+    if (node == nullptr)
+        throw std::runtime_error("Directory not found.");
+    range._base = node - _nodes;
+    return range;
+}
+
+FileReader::EntryRange FileReader::files(std::string_view basePath, int depth) const {
+    return entries(basePath, depth, EntryFilter::Files);
+}
+
+FileReader::EntryRange FileReader::directories(std::string_view basePath, int depth) const {
+    return entries(basePath, depth, EntryFilter::Directories);
+}
+
+void FileReader::iterateFiles(const std::function<void(const std::string&)> callback, std::string_view basePath, int depth) const {
+    for (auto& entry : files(basePath, depth)) {
+        callback(entry.path());
+    }
+}
+
+void FileReader::iterateDirectories(const std::function<void(const std::string& path)> callback, std::string_view basePath, int depth) const {
+    for (auto& entry : directories(basePath, depth)) {
+        callback(entry.path());
     }
-    return false;
 }
 
-void FileReader::readHeader() {
+void FileReader::iterateEntries(const std::function<void(const std::string& path, bool is_directory)> callback, std::string_view basePath, int depth) const {
+    for (auto& entry : entries(basePath, depth)) {
+        callback(entry.path(), entry.is_dir());
+    }
+}
+
+bool FileReader::exists(std::string_view path) const {
+    if (!_opened)
+        throw std::runtime_error("File is not opened");
+    return findNode(path, -1) != nullptr;
+}
+
+bool FileReader::is_file(std::string_view path) const {
+    if (!_opened)
+        throw std::runtime_error("File is not opened");
+    return findNode(path, ENTRYDATA_TYPE_FILE) != nullptr;
+}
+
+bool FileReader::is_dir(std::string_view path) const {
+    if (!_opened)
+        throw std::runtime_error("File is not opened");
+    return findNode(path, ENTRYDATA_TYPE_DIR) != nullptr;
+}
+
+void FileReader::readHeader(std::istream& in) {
     std::vector<char> buffer(4);
-    _file.read(buffer.data(), 4);  // Read magic header
+    in.read(buffer.data(), 4);  // Read magic header
 
     std::string magic(buffer.begin(), buffer.end());
     if (magic != "HONK")
-        throw new std::runtime_error("Invalid archive format");
+        throw std::runtime_error("Invalid archive format");
 
-    _file.read(buffer.data(), 1);  // Read file version
+    in.read(buffer.data(), 1);  // Read file version
     _fileVersion = buffer[0];
+    if (_fileVersion < FORMAT_VERSION_LEGACY || _fileVersion > FORMAT_VERSION_STREAMED)
+        throw std::runtime_error("Unsupported format version");
 
-    _file.read(buffer.data(), 4);  // Read content version
+    in.read(buffer.data(), 4);  // Read content version
     _contentVersion = *((int*)buffer.data());
 }
 
-void FileReader::readEntryTable() {
-    std::vector<char> buffer(4);
-    _file.read(buffer.data(), 4);  // Read entry amount
+void FileReader::readEntryTable(std::istream& in, EntryTable& table) {
+    char buffer[4];
+    in.read(buffer, 4);  // Read entry amount
 
-    int totalEntries = *((int*)buffer.data());
+    int totalEntries = *((int*)buffer);
+    if (totalEntries < 0)
+        throw std::runtime_error("File is corrupted.");
+
+    table.entries.reserve(totalEntries);
     for (int i = 0; i < totalEntries; i++) {
-        readEntry();
+        readEntry(in, table);
     }
+    if (!in)
+        throw std::runtime_error("File is corrupted. Entry table is truncated.");
 }
 
-void FileReader::readEntry() {
-    std::vector<char> buffer(4);
-    std::vector<char> buffer2(8);
-    auto entry = std::make_unique<FileTreeNode>();
+void FileReader::readEntry(std::istream& in, EntryTable& table) {
+    char buffer[8];
+    RawEntry entry = {};
 
-    _file.read(buffer.data(), 4);  // Entry id
-    entry->id = *((int*)buffer.data());
+    in.read(buffer, 4);  // Entry id
+    entry.id = *((int*)buffer);
 
-    std::getline(_file, entry->name, '\0');  // Entry name
-    _file.read(buffer.data(), 1);            // Entry type
-    entry->type = buffer[0];
+    std::getline(in, table.nameBuffer, '\0');  // Entry name
+    entry.name = internName(table, table.nameBuffer);
+    entry.nameLength = table.nameBuffer.size();
 
-    if (entry->type == ENTRYDATA_TYPE_FILE) {
-        _file.read(buffer2.data(), 8);  // File offset (from file section beginning)
-        entry->offset = *((unsigned long long*)buffer2.data());
-        _file.read(buffer.data(), 4);  // File size (in bytes)
-        entry->size = *((int*)buffer.data());
+    in.read(buffer, 1);  // Entry type
+    entry.type = buffer[0];
+
+    if (entry.type == ENTRYDATA_TYPE_FILE) {
+        in.read(buffer, 8);  // File offset (from file section beginning)
+        entry.offset = *((unsigned long long*)buffer);
+        in.read(buffer, 4);  // File size (in bytes)
+        entry.size = static_cast<unsigned int>(*((int*)buffer));
     }
-    if (entry->type == ENTRYDATA_TYPE_DIR) {
-        _file.read(buffer.data(), 4);  // Amount of children ids
-        int totalChildren = *((int*)buffer.data());
+    if (entry.type == ENTRYDATA_TYPE_DIR) {
+        in.read(buffer, 4);  // Amount of children ids
+        int totalChildren = *((int*)buffer);
+        if (totalChildren < 0 || !in)
+            throw std::runtime_error("File is corrupted.");
 
+        entry.firstChildId = table.childIds.size();
+        entry.childCount = totalChildren;
         for (int i = 0; i < totalChildren; i++) {
-            _file.read(buffer.data(), 4);  // Child ID
-            int child = *((int*)buffer.data());
-            entry->children.push_back(child);
+            in.read(buffer, 4);  // Child ID
+            table.childIds.push_back(*((int*)buffer));
         }
     }
 
-    if (_nodes.count(entry->id))
-        throw std::runtime_error("File is corrupted. It contains duplicate entries.");
-    _nodes[entry->id] = std::move(entry);
+    table.entries.push_back(entry);
 }
 
-void FileReader::buildEntryTree() {
-    for (const auto& [id, data] : _nodes) {
-        _root.push_back(data.get());
+unsigned int FileReader::internName(EntryTable& table, const std::string& name) {
+    if (table.nameCount * 2 >= table.nameSlots.size()) {
+        std::vector<NameSlot> slots(std::max<size_t>(64, table.nameSlots.size() * 2), NameSlot{0, NO_NODE, 0});
+        for (auto& slot : table.nameSlots) {
+            if (slot.name == NO_NODE)
+                continue;
+            auto i = slot.hash & (slots.size() - 1);
+            while (slots[i].name != NO_NODE)
+                i = (i + 1) & (slots.size() - 1);
+            slots[i] = slot;
+        }
+        table.nameSlots = std::move(slots);
     }
 
-    std::vector<FileTreeNode*> needToRemove;
-    for (size_t i = 0; i < _nodes.size(); i++) {
-        auto& node = _nodes[i];
-        if (node->type != ENTRYDATA_TYPE_DIR)
+    auto hash = hashString(name);
+    auto mask = table.nameSlots.size() - 1;
+    auto i = hash & mask;
+    for (; table.nameSlots[i].name != NO_NODE; i = (i + 1) & mask) {
+        auto& slot = table.nameSlots[i];
+        if (slot.hash == hash && std::string_view(_nameStorage).substr(slot.name, slot.nameLength) == name)
+            return slot.name;
+    }
+
+    unsigned int offset = _nameStorage.size();
+    _nameStorage += name;
+    table.nameSlots[i] = NameSlot{hash, offset, static_cast<unsigned int>(name.size())};
+    table.nameCount++;
+    return offset;
+}
+
+void FileReader::buildEntryTree(EntryTable& table) {
+    auto& entries = table.entries;
+    auto total = static_cast<unsigned int>(entries.size());
+
+    // Writer assigns ids sequentially, so usually they can index a plain array
+    bool denseIds = std::all_of(entries.begin(), entries.end(), [total](const RawEntry& entry) {
+        return entry.id >= 0 && static_cast<unsigned int>(entry.id) < total;
+    });
+
+    std::vector<unsigned int> denseIndex;
+    std::unordered_map<int, unsigned int> sparseIndex;
+    if (denseIds)
+        denseIndex.assign(total, NO_NODE);
+    else
+        sparseIndex.reserve(total);
+
+    for (unsigned int i = 0; i < total; i++) {
+        bool inserted = denseIds ? (denseIndex[entries[i].id] == NO_NODE) : sparseIndex.emplace(entries[i].id, i).second;
+        if (!inserted)
+            throw std::runtime_error("File is corrupted. It contains duplicate entries.");
+        if (denseIds)
+            denseIndex[entries[i].id] = i;
+    }
+
+    auto indexOf = [&](int id) -> unsigned int {  // Entry id -> index in entry table
+        if (denseIds)
+            return (id >= 0 && static_cast<unsigned int>(id) < total) ? denseIndex[id] : NO_NODE;
+        auto it = sparseIndex.find(id);
+        return (it == sparseIndex.end()) ? NO_NODE : it->second;
+    };
+
+    std::vector<unsigned int> parents(total, NO_NODE);
+    for (unsigned int i = 0; i < total; i++) {
+        auto& entry = entries[i];
+        if (entry.type != ENTRYDATA_TYPE_DIR)
             continue;
 
-        for (auto& childId : node->children) {
-            if (!_nodes.count(childId))
+        for (auto j = entry.firstChildId; j < entry.firstChildId + entry.childCount; j++) {
+            auto child = indexOf(table.childIds[j]);
+            if (child == NO_NODE)
                 throw std::runtime_error("File is corrupted. There are missing entries.");
+            if (child == i)
+                throw std::runtime_error("File is corrupted. It contains recursive entries.");
+            if (parents[child] != NO_NODE)
+                throw std::runtime_error("File is corrupted. It contains duplicate entries.");
+            parents[child] = i;
+        }
+    }
 
-            auto* parent = node.get();
-            while (parent != nullptr) {
-                if (parent->id == childId)
-                    throw std::runtime_error("File is corrupted. It contains recursive entries.");
-                parent = parent->parent;
-            }
+    // Roots keep the id order
+    std::vector<unsigned int> order;
+    order.reserve(total);
+    if (denseIds) {
+        for (auto index : denseIndex) {
+            if (parents[index] == NO_NODE)
+                order.push_back(index);
+        }
+    } else {
+        for (unsigned int i = 0; i < total; i++) {
+            if (parents[i] == NO_NODE)
+                order.push_back(i);
+        }
+        std::sort(order.begin(), order.end(), [&entries](unsigned int a, unsigned int b) {
+            return entries[a].id < entries[b].id;
+        });
+    }
+    _rootCount = order.size();
+
+    // Lay nodes out breadth-first so every directory owns a contiguous range of children
+    _nodeStorage.assign(total, FileTreeNode{});
+    for (unsigned int i = 0; i < _rootCount; i++) {
+        _nodeStorage[i].parent = NO_NODE;
+    }
+
+    for (size_t i = 0; i < order.size(); i++) {
+        auto& entry = entries[order[i]];
+        auto& node = _nodeStorage[i];
 
-            auto* child = _nodes[childId].get();
-            child->parent = node.get();
-            node->children_nodes.push_back(child);
-            needToRemove.push_back(child);
+        node.offset = entry.offset;
+        node.size = entry.size;
+        node.name = entry.name;
+        node.nameLength = entry.nameLength;
+        node.type = entry.type;
+        node.firstChild = order.size();
+        node.childCount = entry.childCount;
+
+        for (auto j = entry.firstChildId; j < entry.firstChildId + entry.childCount; j++) {
+            _nodeStorage[order.size()].parent = i;
+            order.push_back(indexOf(table.childIds[j]));
         }
     }
 
-    _root.erase(std::remove_if(_root.begin(), _root.end(),
-                               [needToRemove](FileTreeNode* node) {
-                                   return std::find(needToRemove.begin(), needToRemove.end(), node) != needToRemove.end();
-                               }),
-                _root.end());
+    // Every entry has at most one parent, so whatever isn't reachable from roots forms a cycle
+    if (order.size() != total)
+        throw std::runtime_error("File is corrupted. It contains recursive entries.");
+
+    _nodes = _nodeStorage.data();
+    _nodeCount = total;
+    _names = _nameStorage;
 }
 
-void FileReader::readMetadata() {
+void FileReader::readMetadata(std::istream& in) {
     std::vector<char> buffer(4);
-    _file.read(buffer.data(), 4);  // Metadata names table size - always 0
-    _file.read(buffer.data(), 4);  // Metadata values table size - always 0
+    in.read(buffer.data(), 4);  // Metadata names table size - always 0
+    in.read(buffer.data(), 4);  // Metadata values table size - always 0
 }
 
-std::string FileReader::buildPath(FileTreeNode* node) {
-    std::vector<std::string> skip(0);
-    return buildPath(node, skip);
+std::string_view FileReader::nodeName(const FileTreeNode* node) const {
+    return std::string_view(_names).substr(node->name, node->nameLength);
 }
 
-std::string FileReader::buildPath(FileTreeNode* node, const std::vector<std::string>& skip) {
-    std::vector<std::string> path;
+std::string FileReader::buildPath(unsigned int node, unsigned int base) const {
+    size_t length = 0;
+    for (auto i = node; i != base; i = _nodes[i].parent) {
+        length += _nodes[i].nameLength + (i == node ? 0 : 1);
+    }
 
-    auto current = node;
-    while (current != nullptr) {
-        path.push_back(current->name);
-        current = current->parent;
+    std::string path(length, '\\');
+    for (auto i = node; i != base; i = _nodes[i].parent) {
+        auto name = nodeName(&_nodes[i]);
+        length -= name.size();
+        path.replace(length, name.size(), name);
+        if (length > 0)
+            length--;  // Keep separator
     }
+    return path;
+}
 
-    int minSize = std::min(skip.size(), path.size());
-    int toRemove = 0;
-    for (int i = 0; i < minSize; i++) {
-        if (path[path.size() - i - 1] != skip[i])
-            break;
-        toRemove++;
+unsigned int FileReader::childrenEnd(unsigned int parent) const {
+    if (parent == NO_NODE)
+        return _rootCount;
+    return _nodes[parent].firstChild + _nodes[parent].childCount;
+}
+
+const FileReader::FileTreeNode* FileReader::getNode(std::string_view path) const {
+    return findNode(path, ENTRYDATA_TYPE_DIR);
+}
+
+const FileReader::FileTreeNode* FileReader::getFileNode(std::string_view path) const {
+    auto* node = findNode(path, ENTRYDATA_TYPE_FILE);
+    if (node == nullptr)
+        throw std::runtime_error("File not found.");
+    recordAccess(node);
+    return node;
+}
+
+void FileReader::recordAccess(const FileTreeNode* node) const {
+    if (!_recorder)
+        return;
+
+    auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _recorder->start).count();
+    unsigned int index = node - _nodes;
+    std::lock_guard<std::mutex> lock(_recorder->mutex);
+    if (_recorder->seen[index])
+        return;
+    _recorder->seen[index] = true;
+    _recorder->accesses.emplace_back(index, time);
+}
+
+FileView FileReader::readRawData(unsigned long long offset, unsigned long long size, std::vector<char>& buffer) const {
+    if (size == 0)
+        return FileView();
+
+    auto begin = _fileSectionBegin + offset;
+    if (_mode == OpenMode::Mapped) {
+        if (begin + size > _mapping.size() || begin + size < begin)
+            throw std::runtime_error("File is corrupted. Entry is out of bounds.");
+        return FileView(_mapping.data() + begin, size);
+    }
+
+    buffer.resize(size);
+    _source.readAt(begin, buffer.data(), size);
+    return FileView(buffer.data(), size);
+}
+
+void FileReader::readEntryData(const FileTreeNode* node, unsigned long long position, char* output, size_t size) const {
+    if (position > node->size || size > node->size - position)
+        throw std::runtime_error("Read is out of entry bounds");
+    if (size == 0)
+        return;
+
+    std::vector<char> buffer;
+    if (node->codec == CODEC_STORED) {
+        if (_mode == OpenMode::Mapped)
+            std::memcpy(output, readRawData(node->offset + position, size, buffer).data(), size);
+        else
+            _source.readAt(_fileSectionBegin + node->offset + position, output, size);
+        return;
+    }
+
+    auto chunkSize = 1ULL << node->chunkShift;
+    auto chunkCount = (node->size + chunkSize - 1) / chunkSize;
+    auto firstChunk = position / chunkSize;
+    auto lastChunk = (position + size - 1) / chunkSize;
+
+    // Only the part of chunk table up to the last touched chunk is needed
+    bool trailingTable = (node->flags & ENTRY_FLAG_TRAILING_TABLE) != 0;
+    auto tableBegin = trailingTable ? node->storedSize - chunkCount * 4 : 0;
+    auto dataBegin = trailingTable ? 0 : chunkCount * 4;
+    std::vector<char> tableBuffer;
+    auto tableView = readRawData(node->offset + tableBegin, (lastChunk + 1) * 4, tableBuffer);
+    std::vector<unsigned int> table(lastChunk + 1);
+    std::memcpy(table.data(), tableView.data(), table.size() * 4);
+
+    unsigned long long start = dataBegin;
+    for (unsigned long long i = 0; i < firstChunk; i++) {
+        start += table[i];
+    }
+    unsigned long long span = 0;
+    for (auto i = firstChunk; i <= lastChunk; i++) {
+        span += table[i];
+    }
+    if (start + span > dataBegin + node->storedSize - chunkCount * 4)
+        throw std::runtime_error("File is corrupted. Invalid chunk table.");
+
+    auto compressed = readRawData(node->offset + start, span, buffer);
+    decodeChunks(node, table.data(), compressed.data(), position, output, size);
+}
+
+void FileReader::decodeEntry(const FileTreeNode* node, const char* data, char* output) const {
+    if (node->size == 0)
+        return;
+    if (node->codec == CODEC_STORED) {
+        std::memcpy(output, data, node->size);
+        return;
+    }
+
+    auto chunkCount = (node->size + (1ULL << node->chunkShift) - 1) >> node->chunkShift;
+    bool trailingTable = (node->flags & ENTRY_FLAG_TRAILING_TABLE) != 0;
+    std::vector<unsigned int> table(chunkCount);
+    std::memcpy(table.data(), data + (trailingTable ? node->storedSize - chunkCount * 4 : 0), chunkCount * 4);
+
+    unsigned long long span = chunkCount * 4;
+    for (auto size : table) {
+        span += size;
+    }
+    if (span > node->storedSize)
+        throw std::runtime_error("File is corrupted. Invalid chunk table.");
+
+    decodeChunks(node, table.data(), data + (trailingTable ? 0 : chunkCount * 4), 0, output, node->size);
+}
+
+void FileReader::verifyEntry(const FileTreeNode* node, const char* data) const {
+    if (_verifyMode == VerifyMode::Never || !(node->flags & ENTRY_FLAG_CHECKSUM))
+        return;
+
+    auto& verified = _verified[node - _nodes];
+    if (_verifyMode == VerifyMode::FirstRead && verified.load(std::memory_order_relaxed))
+        return;
+    if (crc32c(data, node->size) != node->checksum)
+        throw std::runtime_error("File is corrupted. Checksum mismatch.");
+    verified.store(true, std::memory_order_relaxed);
+}
+
+void FileReader::decodeChunks(const FileTreeNode* node, const unsigned int* table, const char* src, unsigned long long position, char* output, size_t size) const {
+    auto chunkSize = 1ULL << node->chunkShift;
+    auto firstChunk = position / chunkSize;
+    auto lastChunk = (position + size - 1) / chunkSize;
+    auto* codec = codecOf(node->codec);
+
+    std::vector<char> scratch;
+    for (auto i = firstChunk; i <= lastChunk; i++) {
+        auto chunkBegin = i * chunkSize;
+        auto rawSize = std::min(chunkSize, node->size - chunkBegin);
+        if (table[i] > rawSize)
+            throw std::runtime_error("File is corrupted. Invalid chunk table.");
+
+        // Part of this chunk that was requested
+        auto from = std::max(position, chunkBegin) - chunkBegin;
+        auto to = std::min(position + size, chunkBegin + rawSize) - chunkBegin;
+        auto* target = output + (chunkBegin + from - position);
+
+        if (table[i] == rawSize) {
+            std::memcpy(target, src + from, to - from);  // Chunk didn't compress and is stored as is
+        } else if (from == 0 && to == rawSize) {
+            codec->decompress(src, table[i], target, rawSize);
+        } else {
+            scratch.resize(rawSize);
+            codec->decompress(src, table[i], scratch.data(), rawSize);
+            std::memcpy(target, scratch.data() + from, to - from);
+        }
+        src += table[i];
+    }
+}
+
+const Codec* FileReader::codecOf(unsigned char id) const {
+    auto* codec = _codecs[id].load(std::memory_order_acquire);
+    if (codec != nullptr)
+        return codec;
+
+    std::lock_guard<std::mutex> lock(_codecMutex);
+    codec = _codecs[id].load(std::memory_order_relaxed);
+    if (codec == nullptr) {
+        _codecOwners.push_back(getCodec(id));  // Keeps the codec alive even if it is replaced in the registry
+        codec = _codecOwners.back().get();
+        _codecs[id].store(codec, std::memory_order_release);
+    }
+    return codec;
+}
+
+void FileReader::buildIndex() {
+    size_t capacity = 16;
+    while (capacity < _nodeCount * 2)
+        capacity <<= 1;
+    _indexStorage.assign(capacity, IndexSlot{0, NO_NODE, 0});
+
+    // Parents always precede their children in the node table
+    std::vector<unsigned long long> hashes(_nodeCount);
+    for (unsigned int i = 0; i < _nodeCount; i++) {
+        auto& node = _nodes[i];
+        auto seed = (node.parent == NO_NODE) ? hashString("") : hashString("\\", hashes[node.parent]);
+        hashes[i] = hashFolded(nodeName(&node), seed);  // Same as queries, whatever case the writer stored
+
+        auto slot = hashes[i] & (capacity - 1);
+        while (_indexStorage[slot].entry != NO_NODE)
+            slot = (slot + 1) & (capacity - 1);
+        _indexStorage[slot] = IndexSlot{hashes[i], i, 0};
+    }
+
+    _index = _indexStorage.data();
+    _indexCapacity = capacity;
+}
+
+void FileReader::readFrozenIndex(std::istream& in) {
+    char buffer[8];
+    in.seekg(FROZEN_INDEX_OFFSET);
+    in.read(buffer, 8);  // Index block size
+    auto size = *((unsigned long long*)buffer);
+    if (!in)
+        throw std::runtime_error("File is corrupted. Index is truncated.");
+
+    loadIndexBlock(in, FROZEN_INDEX_OFFSET + 8, size);
+}
+
+void FileReader::readTrailingIndex(std::istream& in) {
+    unsigned long long offset, size;
+    locateIndex(in, offset, size);
+    loadIndexBlock(in, offset, size);
+}
+
+void FileReader::locateIndex(std::istream& in, unsigned long long& offset, unsigned long long& size) {
+    if (_fileVersion >= FORMAT_VERSION_STREAMED) {
+        // Header was written before the index, the footer points at it
+        StreamFooter footer;
+        if (_source.size() < TRAILING_HEADER_SIZE + sizeof(StreamFooter))
+            throw std::runtime_error("File is corrupted. Index is truncated.");
+        _source.readAt(_source.size() - sizeof(StreamFooter), reinterpret_cast<char*>(&footer), sizeof(StreamFooter));
+        if (std::memcmp(footer.magic, "HONK", 4) != 0)
+            throw std::runtime_error("File is corrupted. Index is truncated.");
+        offset = footer.indexOffset;
+        size = footer.indexSize;
+        _contentVersion = footer.contentVersion;
+    } else {
+        char buffer[16];
+        in.seekg(FROZEN_INDEX_OFFSET);
+        in.read(buffer, 16);  // Index block offset and size
+        offset = *((unsigned long long*)buffer);
+        size = *((unsigned long long*)(buffer + 8));
+        if (!in)
+            throw std::runtime_error("File is corrupted. Index is truncated.");
+    }
+    if (offset < TRAILING_HEADER_SIZE || offset % 8 != 0)
+        throw std::runtime_error("File is corrupted. Index is truncated.");
+}
+
+void FileReader::loadIndexBlock(std::istream& in, unsigned long long begin, unsigned long long size) {
+    if (size < sizeof(IndexHeader) || begin + size > _source.size() || begin + size < begin)
+        throw std::runtime_error("File is corrupted. Index is truncated.");
+
+    if (_mode == OpenMode::Mapped) {
+        useFrozenIndex(_mapping.data() + begin, size);  // Index is used right from the mapping
+    } else {
+        _indexBlock.resize((size + 7) / 8);
+        in.seekg(begin);
+        in.read(reinterpret_cast<char*>(_indexBlock.data()), size);
+        if (!in)
+            throw std::runtime_error("File is corrupted. Index is truncated.");
+        useFrozenIndex(reinterpret_cast<const char*>(_indexBlock.data()), size);
+    }
+    in.seekg(begin + size);
+}
+
+void FileReader::useFrozenIndex(const char* block, unsigned long long size) {
+    auto* header = reinterpret_cast<const IndexHeader*>(block);
+    if (header->entrySize < FROZEN_ENTRY_MIN_SIZE || header->entrySize % 8 != 0)
+        throw std::runtime_error("Unsupported index entry size");
+    if (header->slotCount > 0 && ((header->slotCount & (header->slotCount - 1)) != 0 || header->slotCount <= header->entryCount))
+        throw std::runtime_error("File is corrupted. Invalid path index.");
+
+    auto entriesSize = (unsigned long long)header->entryCount * header->entrySize;
+    auto slotsSize = (unsigned long long)header->slotCount * sizeof(IndexSlot);
+    if (sizeof(IndexHeader) + entriesSize + slotsSize + header->namesSize > size)
+        throw std::runtime_error("File is corrupted. Index is truncated.");
+
+    auto* entries = block + sizeof(IndexHeader);
+    if (header->entrySize == sizeof(IndexEntry)) {
+        _nodes = reinterpret_cast<const FileTreeNode*>(entries);
+    } else {
+        // Written with another revision of the entry layout, copy known fields
+        auto known = std::min<size_t>(header->entrySize, sizeof(IndexEntry));
+        _nodeStorage.assign(header->entryCount, FileTreeNode{});
+        for (size_t i = 0; i < header->entryCount; i++) {
+            std::memcpy(&_nodeStorage[i], entries + i * header->entrySize, known);
+        }
+        _nodes = _nodeStorage.data();
+    }
+    _nodeCount = header->entryCount;
+    _rootCount = header->rootCount;
+    _names = std::string_view(entries + entriesSize + slotsSize, header->namesSize);
+    validateNodeTable();
+
+    if (header->slotCount > 0) {
+        _index = reinterpret_cast<const IndexSlot*>(entries + entriesSize);
+        _indexCapacity = header->slotCount;
+        size_t used = 0;
+        for (size_t i = 0; i < _indexCapacity; i++) {
+            if (_index[i].entry == NO_NODE)
+                continue;
+            if (_index[i].entry >= _nodeCount || ++used > _nodeCount)
+                throw std::runtime_error("File is corrupted. Invalid path index.");
+        }
+    } else {
+        buildIndex();
+    }
+}
+
+void FileReader::validateNodeTable() const {
+    if (_rootCount > _nodeCount)
+        throw std::runtime_error("File is corrupted. There are missing entries.");
+
+    unsigned long long totalChildren = _rootCount;
+    for (unsigned int i = 0; i < _nodeCount; i++) {
+        auto& node = _nodes[i];
+        totalChildren += node.childCount;
+        validateEntry(i);
+
+        // Root entries come first, every other entry must sit inside its parent's children range
+        if (i < _rootCount) {
+            if (node.parent != NO_NODE)
+                throw std::runtime_error("File is corrupted. It contains duplicate entries.");
+        } else {
+            if (node.parent >= i)
+                throw std::runtime_error("File is corrupted. It contains recursive entries.");
+            auto& parent = _nodes[node.parent];
+            if (i < parent.firstChild || i >= parent.firstChild + parent.childCount)
+                throw std::runtime_error("File is corrupted. It contains duplicate entries.");
+        }
+    }
+
+    // Together with the checks above this makes children ranges a partition of non-root entries
+    if (totalChildren != _nodeCount)
+        throw std::runtime_error("File is corrupted. It contains duplicate entries.");
+}
+
+void FileReader::validateEntry(unsigned int i) const {
+    auto& node = _nodes[i];
+    if ((unsigned long long)node.name + node.nameLength > _names.size())
+        throw std::runtime_error("File is corrupted. There are missing entries.");
+
+    if (node.codec != CODEC_STORED) {
+        if (node.chunkShift < 10 || node.chunkShift > 30)
+            throw std::runtime_error("File is corrupted. Invalid chunk size.");
+        auto chunkCount = (node.size + (1ULL << node.chunkShift) - 1) >> node.chunkShift;
+        if (node.storedSize < chunkCount * 4)
+            throw std::runtime_error("File is corrupted. Invalid chunk table.");
+    }
+
+    if (node.type == ENTRYDATA_TYPE_DIR && node.childCount > 0) {
+        if (node.firstChild <= i || (unsigned long long)node.firstChild + node.childCount > _nodeCount)
+            throw std::runtime_error("File is corrupted. There are missing entries.");
+    } else if (node.childCount > 0) {
+        throw std::runtime_error("File is corrupted.");
+    }
+}
+
+void FileReader::readLazyIndex(std::istream& in) {
+    unsigned long long offset, size;
+    locateIndex(in, offset, size);
+    if (size < sizeof(LazyIndexHeader))
+        throw std::runtime_error("File is corrupted. Index is truncated.");
+    if (offset + size > _source.size() || offset + size < offset)
+        throw std::runtime_error("File is corrupted. Index is truncated.");
+
+    LazyIndexHeader header;
+    _source.readAt(offset, reinterpret_cast<char*>(&header), sizeof(LazyIndexHeader));
+    if (header.entrySize < FROZEN_ENTRY_MIN_SIZE || header.entrySize % 8 != 0)
+        throw std::runtime_error("Unsupported index entry size");
+    if ((unsigned long long)header.entryCount * header.entrySize > size || header.namesSize > size || header.rootCount > header.entryCount)
+        throw std::runtime_error("File is corrupted. Index is truncated.");
+
+    // Nothing but the root block is read here, storage for the rest is allocated without being touched
+    _lazy = true;
+    _lazyEntrySize = header.entrySize;
+    _indexBegin = offset;
+    _indexEnd = offset + size;
+    _nodeCount = header.entryCount;
+    _rootCount = header.rootCount;
+    _lazyNodes.reset(new FileTreeNode[_nodeCount]);
+    _lazyNames.reset(new char[header.namesSize]);
+    _nodeState.reset(new std::atomic<unsigned char>[_nodeCount]());
+    _nodes = _lazyNodes.get();
+    _names = std::string_view(_lazyNames.get(), header.namesSize);
+
+    // Other modes load the whole tree now, from a single read of the index
+    if (_mode != OpenMode::Lazy) {
+        _indexBlock.resize((size + 7) / 8);
+        _source.readAt(offset, reinterpret_cast<char*>(_indexBlock.data()), size);
+    }
+
+    std::vector<char> root;
+    auto rootOffset = offset + sizeof(LazyIndexHeader);
+    loadBlock(NO_NODE, indexData(rootOffset, header.rootBlockSize, root), header.rootBlockSize);
+    if (_mode != OpenMode::Lazy) {
+        loadAll();
+        _indexBlock.clear();
+        _indexBlock.shrink_to_fit();
+    }
+    in.seekg(offset + size);
+}
+
+const char* FileReader::indexData(unsigned long long offset, unsigned long long size, std::vector<char>& buffer) const {
+    if (offset < _indexBegin || offset > _indexEnd || size > _indexEnd - offset)
+        throw std::runtime_error("File is corrupted. Index is truncated.");
+    if (!_indexBlock.empty())
+        return reinterpret_cast<const char*>(_indexBlock.data()) + (offset - _indexBegin);
+
+    buffer.resize(size);
+    _source.readAt(offset, buffer.data(), size);
+    return buffer.data();
+}
+
+void FileReader::loadBlock(unsigned int dir, const char* block, unsigned long long size) const {
+    auto first = (dir == NO_NODE) ? 0 : _nodes[dir].firstChild;
+    auto count = (dir == NO_NODE) ? _rootCount : _nodes[dir].childCount;
+    auto entriesSize = (unsigned long long)count * _lazyEntrySize;
+    if (entriesSize > size)
+        throw std::runtime_error("File is corrupted. Index is truncated.");
+    auto namesSize = size - entriesSize;
+    if (namesSize > _names.size() - _namesUsed)
+        throw std::runtime_error("File is corrupted. There are missing entries.");
+
+    // Names are moved behind the names of blocks loaded before
+    auto* names = block + entriesSize;
+    std::memcpy(_lazyNames.get() + _namesUsed, names, namesSize);
+
+    auto known = std::min<size_t>(_lazyEntrySize, sizeof(IndexEntry));
+    std::string_view previous;
+    for (unsigned int i = 0; i < count; i++) {
+        auto index = first + i;
+        if (_nodeState[index].load(std::memory_order_relaxed) & NODE_PRESENT)
+            throw std::runtime_error("File is corrupted. It contains duplicate entries.");
+
+        auto& node = _lazyNodes[index];
+        node = FileTreeNode{};
+        std::memcpy(&node, block + i * _lazyEntrySize, known);
+        if (node.parent != dir)
+            throw std::runtime_error("File is corrupted. It contains duplicate entries.");
+        if ((unsigned long long)node.name + node.nameLength > namesSize)
+            throw std::runtime_error("File is corrupted. There are missing entries.");
+
+        // Sorted names is what makes binary search of children possible
+        std::string_view name(names + node.name, node.nameLength);
+        if (i > 0 && compareFolded(previous, name) >= 0)
+            throw std::runtime_error("File is corrupted. Entries are not sorted.");
+        previous = name;
+
+        node.name += _namesUsed;
+        validateEntry(index);
+    }
+    _namesUsed += namesSize;
+
+    for (unsigned int i = 0; i < count; i++) {
+        _nodeState[first + i].fetch_or(NODE_PRESENT, std::memory_order_release);
+    }
+}
+
+void FileReader::loadDirectory(unsigned int dir) const {
+    if (isLoaded(dir))
+        return;
+
+    std::lock_guard<std::mutex> lock(_loadMutex);
+    if (_nodeState[dir].load(std::memory_order_relaxed) & NODE_LOADED)
+        return;  // Loaded by another thread meanwhile
+
+    auto& node = _nodes[dir];
+    if (node.childCount > 0) {
+        std::vector<char> buffer;
+        loadBlock(dir, indexData(node.offset, node.storedSize, buffer), node.storedSize);
     }
+#ifdef GOOSEVF_ENABLE_STATS
+    if (_stats)
+        assignPrefixes(dir);
+#endif
+    _nodeState[dir].fetch_or(NODE_LOADED, std::memory_order_release);
+}
 
-    path.resize(path.size() - toRemove);
-    std::reverse(path.begin(), path.end());
+void FileReader::loadAllDirectories() const {
+    if (!_lazy)
+        return;
+
+    // Children always follow their parent, so a single pass loads the whole tree
+    for (unsigned int i = 0; i < _nodeCount; i++) {
+        if (isPresent(i) && _nodes[i].type == ENTRYDATA_TYPE_DIR)
+            loadDirectory(i);
+    }
+}
+
+void FileReader::loadAll() {
+    if (!_lazy)
+        return;
+
+    loadAllDirectories();
+    for (unsigned int i = 0; i < _nodeCount; i++) {
+        if (!isPresent(i))
+            throw std::runtime_error("File is corrupted. There are missing entries.");
+    }
+    validateNodeTable();
+    buildIndex();
+    _lazy = false;
+    _nodeState.reset();
+}
+
+bool FileReader::isPresent(unsigned int node) const {
+    return !_lazy || (_nodeState[node].load(std::memory_order_acquire) & NODE_PRESENT);
+}
 
-    return GooseVF::buildPath(path);
+bool FileReader::isLoaded(unsigned int node) const {
+    return !_lazy || (_nodeState[node].load(std::memory_order_acquire) & NODE_LOADED);
 }
 
-FileReader::FileTreeNode* FileReader::getNode(const std::string& path) {
-    auto parts = splitPath(path);
-    if (parts[0] == ".")
-        parts.erase(parts.begin());
-    if (parts.size() == 0)
+const FileReader::FileTreeNode* FileReader::findNode(std::string_view path, int type) const {
+    if (_lazy) {
+        STATS_START(start);
+        auto* node = walkPath(path, type);
+        if (node == nullptr && PathTokenizer(path).empty())
+            return nullptr;
+        STATS_LOOKUP(node, path, start);
+        return node;
+    }
+    if (_index == nullptr)
+        return nullptr;
+
+    STATS_START(start);
+    unsigned long long hash;
+    if (hashPath(path, hash) == 0)
         return nullptr;
 
-    auto* arr = &_root;
-    FileReader::FileTreeNode* node = nullptr;
-    for (auto& part : parts) {
-        auto it = std::find_if(arr->begin(), arr->end(),
-                               [&part](FileTreeNode* n) {
-                                   return (!n->name.compare(part)) && (n->type == ENTRYDATA_TYPE_DIR);
-                               });
-        if (it == arr->end()) {
+    auto mask = _indexCapacity - 1;
+    for (auto slot = hash & mask; _index[slot].entry != NO_NODE; slot = (slot + 1) & mask) {
+        auto& entry = _index[slot];
+        if (entry.hash != hash)
+            continue;
+
+        auto* node = &_nodes[entry.entry];
+        if (type >= 0 && node->type != type)
+            continue;
+        if (matchesPath(node, path)) {
+            STATS_LOOKUP(node, path, start);
+            return node;
+        }
+    }
+    STATS_LOOKUP(nullptr, path, start);
+    return nullptr;
+}
+
+bool FileReader::matchesPath(const FileTreeNode* node, std::string_view path) const {
+    PathTokenizer tokenizer(path);
+    std::string_view name;
+    while (node != nullptr && tokenizer.nextFromEnd(name)) {
+        if (!equalsFolded(nodeName(node), name))
+            return false;
+        node = (node->parent == NO_NODE) ? nullptr : &_nodes[node->parent];
+    }
+    return node == nullptr && tokenizer.empty();
+}
+
+const FileReader::FileTreeNode* FileReader::walkPath(std::string_view path, int type) const {
+    PathTokenizer tokenizer(path);
+    std::string_view name;
+    auto node = NO_NODE;
+    while (tokenizer.next(name)) {
+        if (node != NO_NODE) {
+            if (_nodes[node].type != ENTRYDATA_TYPE_DIR)
+                return nullptr;
+            loadDirectory(node);  // One read of its block, the first time only
+        }
+        auto child = findChild(node, name);
+        if (child == NO_NODE)
             return nullptr;
+        node = child;
+    }
+
+    if (node == NO_NODE || (type >= 0 && _nodes[node].type != type))
+        return nullptr;
+    return &_nodes[node];
+}
+
+unsigned int FileReader::findChild(unsigned int dir, std::string_view name) const {
+    auto first = (dir == NO_NODE) ? 0 : _nodes[dir].firstChild;
+    auto last = childrenEnd(dir);
+    while (first < last) {
+        auto middle = first + (last - first) / 2;
+        auto order = compareFolded(nodeName(&_nodes[middle]), name);
+        if (order == 0)
+            return middle;
+        if (order < 0)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+    return NO_NODE;
+}
+
+#ifdef GOOSEVF_ENABLE_STATS
+FileReader::StatsTable::~StatsTable() {
+    for (auto& slot : counters) {
+        delete slot.load();
+    }
+}
+
+unsigned long long FileReader::statsClock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void FileReader::buildStatsTable() {
+    // Sized upfront, lazy readers add slots while other threads count
+    auto capacity = 1 + std::min<size_t>(_nodeCount, STATS_MAX_PREFIXES);
+    auto table = std::make_unique<StatsTable>();
+    table->prefixOf.reset(new unsigned int[_nodeCount]);
+    table->prefixNodes.reserve(capacity);
+    table->prefixNodes.push_back(NO_NODE);
+    table->counters = std::vector<std::atomic<PrefixCounters*>>(capacity);
+    _stats = std::move(table);
+
+    // Parents precede their children in the node table, so every parent has its slot first
+    assignPrefixes(NO_NODE);
+    for (unsigned int i = 0; i < _nodeCount; i++) {
+        if (isLoaded(i) && _nodes[i].type == ENTRYDATA_TYPE_DIR)
+            assignPrefixes(i);
+    }
+}
+
+void FileReader::assignPrefixes(unsigned int dir) const {
+    unsigned int depth = 1;  // Of the children
+    for (auto i = dir; i != NO_NODE && depth <= _statsDepth; i = _nodes[i].parent) {
+        depth++;
+    }
+
+    // Directories up to the stats depth get their own slot
+    auto& table = *_stats;
+    auto slot = (dir == NO_NODE) ? 0 : table.prefixOf[dir];
+    auto first = (dir == NO_NODE) ? 0 : _nodes[dir].firstChild;
+    for (auto child = first; child < childrenEnd(dir); child++) {
+        table.prefixOf[child] = slot;
+        if (_nodes[child].type == ENTRYDATA_TYPE_DIR && depth <= _statsDepth && table.prefixNodes.size() < table.counters.size()) {
+            table.prefixOf[child] = table.prefixNodes.size();
+            table.prefixNodes.push_back(child);
         }
-        node = *it;
-        arr = &node->children_nodes;
     }
-    return node;
-}
\ No newline at end of file
+}
+
+FileReader::PrefixCounters& FileReader::prefixCounters(unsigned int slot) const {
+    auto& entry = _stats->counters[slot];
+    auto* counters = entry.load(std::memory_order_acquire);
+    if (counters != nullptr)
+        return *counters;
+
+    auto* created = new PrefixCounters();
+    if (entry.compare_exchange_strong(counters, created, std::memory_order_acq_rel))
+        return *created;
+    delete created;  // Another thread was first
+    return *counters;
+}
+
+unsigned int FileReader::missedPrefix(std::string_view path) const {
+    // Longest existing directory among the first levels of the path
+    if (_lazy) {
+        // Directories on the way were loaded by the lookup, the last name is the missed entry itself
+        PathTokenizer tokenizer(path);
+        std::string_view name, next;
+        unsigned int slot = 0;
+        auto dir = NO_NODE;
+        bool more = tokenizer.next(name);
+        for (unsigned int level = 0; level < _statsDepth && tokenizer.next(next); level++) {
+            if (dir != NO_NODE && !isLoaded(dir))
+                break;
+            auto child = findChild(dir, name);
+            if (child == NO_NODE || _nodes[child].type != ENTRYDATA_TYPE_DIR)
+                break;
+            slot = _stats->prefixOf[child];
+            dir = child;
+            name = next;
+        }
+        return more ? slot : 0;
+    }
+
+    unsigned long long hash;
+    auto names = hashPath(path, hash);
+    auto mask = _indexCapacity - 1;
+    for (auto level = std::min<size_t>(_statsDepth, names - 1); level > 0; level--) {
+        hashPath(path, hash, level);
+
+        // Path of the directory ends where its last name does
+        PathTokenizer tokenizer(path);
+        std::string_view name;
+        for (size_t i = 0; i < level; i++) {
+            tokenizer.next(name);
+        }
+        auto prefix = path.substr(0, name.data() + name.size() - path.data());
+
+        for (auto slot = hash & mask; _index[slot].entry != NO_NODE; slot = (slot + 1) & mask) {
+            auto* node = &_nodes[_index[slot].entry];
+            if (_index[slot].hash == hash && node->type == ENTRYDATA_TYPE_DIR && matchesPath(node, prefix))
+                return _stats->prefixOf[node - _nodes];
+        }
+    }
+    return 0;
+}
+
+void FileReader::recordLookup(const FileTreeNode* node, std::string_view path, unsigned long long start) const {
+    if (!_stats)
+        return;
+
+    auto elapsed = statsClock() - start;
+    auto& counters = prefixCounters(node != nullptr ? _stats->prefixOf[node - _nodes] : missedPrefix(path));
+    counters.lookups.fetch_add(1, std::memory_order_relaxed);
+    if (node == nullptr)
+        counters.misses.fetch_add(1, std::memory_order_relaxed);
+    counters.lookupLatency[latencyBucket(elapsed)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void FileReader::recordRead(const FileTreeNode* node, std::string_view path, unsigned long long offset, unsigned long long size, unsigned long long start) const {
+    auto elapsed = statsClock() - start;
+    auto& counters = prefixCounters(_stats->prefixOf[node - _nodes]);
+    counters.reads.fetch_add(1, std::memory_order_relaxed);
+    counters.bytesRead.fetch_add(size, std::memory_order_relaxed);
+    counters.readLatency[latencyBucket(elapsed)].fetch_add(1, std::memory_order_relaxed);
+    if (_traceHook)
+        _traceHook(ReadEvent{path, offset, size, elapsed});
+}
+#endif
+
+std::string_view FileReader::Entry::name() const {
+    return _reader->nodeName(&_reader->_nodes[_node]);
+}
+
+std::string FileReader::Entry::path() const {
+    return _reader->buildPath(_node, _base);
+}
+
+std::string FileReader::Entry::fullPath() const {
+    return _reader->buildPath(_node);
+}
+
+bool FileReader::Entry::is_file() const {
+    return _reader->_nodes[_node].type == ENTRYDATA_TYPE_FILE;
+}
+
+bool FileReader::Entry::is_dir() const {
+    return _reader->_nodes[_node].type == ENTRYDATA_TYPE_DIR;
+}
+
+unsigned long long FileReader::Entry::size() const {
+    return _reader->_nodes[_node].size;
+}
+
+int FileReader::Entry::depth() const {
+    return _depth;
+}
+
+FileReader::EntryIterator& FileReader::EntryIterator::operator++() {
+    do {
+        advance();
+    } while (_entry._node != NO_NODE && !accepted());
+    return *this;
+}
+
+FileReader::EntryIterator FileReader::EntryIterator::operator++(int) {
+    auto copy = *this;
+    ++(*this);
+    return copy;
+}
+
+void FileReader::EntryIterator::advance() {
+    auto& nodes = _entry._reader->_nodes;
+    auto& node = nodes[_entry._node];
+
+    bool canDescend = _maxDepth < 0 || _entry._depth < _maxDepth;
+    if (node.type == ENTRYDATA_TYPE_DIR && node.childCount > 0 && canDescend) {
+        _entry._reader->loadDirectory(_entry._node);
+        _entry._node = node.firstChild;
+        _entry._depth++;
+        return;
+    }
+
+    // Move to the next sibling, climbing up while current range is exhausted
+    auto current = _entry._node;
+    while (true) {
+        auto parent = nodes[current].parent;
+        if (current + 1 < _entry._reader->childrenEnd(parent)) {
+            _entry._node = current + 1;
+            return;
+        }
+        if (_entry._depth == 0) {
+            _entry._node = NO_NODE;
+            return;
+        }
+        current = parent;
+        _entry._depth--;
+    }
+}
+
+bool FileReader::EntryIterator::accepted() const {
+    switch (_filter) {
+        case EntryFilter::Files:
+            return _entry.is_file();
+        case EntryFilter::Directories:
+            return _entry.is_dir();
+        default:
+            return true;
+    }
+}
+
+FileReader::EntryIterator FileReader::EntryRange::begin() const {
+    EntryIterator it;
+    it._entry._reader = _reader;
+    it._entry._base = _base;
+    it._maxDepth = _depth;
+    it._filter = _filter;
+
+    if (_base != NO_NODE)
+        _reader->loadDirectory(_base);
+    auto first = (_base == NO_NODE) ? 0 : _reader->_nodes[_base].firstChild;
+    if (first >= _reader->childrenEnd(_base)) {
+        it._entry._node = NO_NODE;
+        return it;
+    }
+
+    it._entry._node = first;
+    if (!it.accepted())
+        ++it;
+    return it;
+}
+
+FileReader::EntryIterator FileReader::EntryRange::end() const {
+    EntryIterator it;
+    it._entry._reader = _reader;
+    it._entry._base = _base;
+    it._entry._node = NO_NODE;
+    return it;
+}
+
+FileReader::EntryStreamBuffer::EntryStreamBuffer(const FileReader& reader, std::string_view path)
+    : _reader(&reader) {
+    if (!reader._opened)
+        throw std::runtime_error("File is not opened");
+
+    auto* node = reader.getFileNode(path);
+    _node = node - reader._nodes;
+#ifdef GOOSEVF_ENABLE_STATS
+    if (reader._traceHook)
+        _path = path;
+#endif
+
+    unsigned long long blockSize = STREAM_BLOCK_SIZE;
+    if (node->codec != CODEC_STORED)
+        blockSize = std::max(blockSize, 1ULL << node->chunkShift);
+    _buffer.resize(std::min(blockSize, node->size));
+    setg(_buffer.data(), _buffer.data(), _buffer.data());
+}
+
+FileReader::EntryStreamBuffer::int_type FileReader::EntryStreamBuffer::underflow() {
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    auto* node = &_reader->_nodes[_node];
+    auto current = position();
+    if (current >= node->size)
+        return traits_type::eof();
+
+    // Compressed blocks start at chunk boundaries, so no chunk is decoded partially
+    auto begin = current;
+    if (node->codec != CODEC_STORED)
+        begin -= current % _buffer.size();
+    auto size = std::min<unsigned long long>(_buffer.size(), node->size - begin);
+
+    STATS_START(start);
+    _reader->readEntryData(node, begin, _buffer.data(), size);
+#ifdef GOOSEVF_ENABLE_STATS
+    _reader->recordRead(node, _path, begin, size, start);
+#endif
+    _bufferPosition = begin;
+    setg(_buffer.data(), _buffer.data() + (current - begin), _buffer.data() + size);
+    return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize FileReader::EntryStreamBuffer::xsgetn(char* s, std::streamsize count) {
+    auto* node = &_reader->_nodes[_node];
+    std::streamsize done = 0;
+
+    while (done < count) {
+        auto available = egptr() - gptr();
+        if (available > 0) {
+            auto size = std::min<std::streamsize>(available, count - done);
+            std::memcpy(s + done, gptr(), size);
+            gbump(static_cast<int>(size));
+            done += size;
+            continue;
+        }
+
+        auto current = position();
+        if (current >= node->size)
+            break;
+
+        // Big reads go straight to the output, skipping the buffer
+        auto remaining = static_cast<unsigned long long>(count - done);
+        if (remaining >= _buffer.size()) {
+            auto size = std::min(remaining, node->size - current);
+            STATS_START(start);
+            _reader->readEntryData(node, current, s + done, size);
+#ifdef GOOSEVF_ENABLE_STATS
+            _reader->recordRead(node, _path, current, size, start);
+#endif
+            done += size;
+            reset(current + size);
+            continue;
+        }
+
+        if (underflow() == traits_type::eof())
+            break;
+    }
+    return done;
+}
+
+std::streamsize FileReader::EntryStreamBuffer::showmanyc() {
+    auto size = _reader->_nodes[_node].size;
+    auto current = position();
+    return current < size ? static_cast<std::streamsize>(size - current) : -1;
+}
+
+FileReader::EntryStreamBuffer::pos_type FileReader::EntryStreamBuffer::seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+    if (!(which & std::ios_base::in))
+        return pos_type(off_type(-1));
+
+    long long base = 0;
+    if (dir == std::ios_base::cur)
+        base = position();
+    else if (dir == std::ios_base::end)
+        base = _reader->_nodes[_node].size;
+
+    auto target = base + offset;
+    if (target < 0 || static_cast<unsigned long long>(target) > _reader->_nodes[_node].size)
+        return pos_type(off_type(-1));
+
+    // Stay inside current buffer if possible
+    if (static_cast<unsigned long long>(target) >= _bufferPosition && static_cast<unsigned long long>(target) <= _bufferPosition + (egptr() - eback()))
+        setg(eback(), eback() + (target - _bufferPosition), egptr());
+    else
+        reset(target);
+    return pos_type(target);
+}
+
+FileReader::EntryStreamBuffer::pos_type FileReader::EntryStreamBuffer::seekpos(pos_type position, std::ios_base::openmode which) {
+    return seekoff(off_type(position), std::ios_base::beg, which);
+}
+
+unsigned long long FileReader::EntryStreamBuffer::position() const {
+    return _bufferPosition + (gptr() - eback());
+}
+
+void FileReader::EntryStreamBuffer::reset(unsigned long long position) {
+    _bufferPosition = position;
+    setg(_buffer.data(), _buffer.data(), _buffer.data());
+}
+
+FileReader::EntryStream::EntryStream(const FileReader& reader, std::string_view path)
+    : std::istream(nullptr), _buffer(reader, path) {
+    rdbuf(&_buffer);
+}
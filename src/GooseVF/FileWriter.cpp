@@ -1,63 +1,396 @@
 #include "GooseVF/FileWriter.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
+#include <functional>
+#include <map>
 #include <queue>
+#include <streambuf>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 
+#include "GooseVF/Checksum.h"
+#include "GooseVF/FileReader.h"
+#include "GooseVF/Format.h"
+#include "GooseVF/RandomAccessFile.h"
 #include "GooseVF/Utility.h"
 
+#define COPY_CHUNK_SIZE (1 << 20)  // Stored files smaller than this are read by workers, bigger ones are copied by the kernel
+#define NOT_DUPLICATE SIZE_MAX
+#define STREAM_BUFFER_LIMIT (256ULL << 20)  // Compressed stream data kept in memory by versions with the chunk table in front
+
 using namespace GooseVF;
 
+namespace {
+    // Contents of a file added from disk or from memory
+    class SourceReader {
+       public:
+        SourceReader(const std::string& path, const std::vector<char>* buffer, unsigned long long size) : _buffer(buffer) {
+            if (_buffer != nullptr)
+                return;
+            _file.open(path);
+            if (_file.size() != size)
+                throw std::runtime_error("File was changed while saving");
+        }
+
+        void readAt(unsigned long long position, char* output, size_t size) {
+            if (_buffer != nullptr)
+                std::memcpy(output, _buffer->data() + position, size);
+            else
+                _file.readAt(position, output, size);
+        }
+
+       private:
+        const std::vector<char>* _buffer;
+        RandomAccessFile _file;
+    };
+
+    // Streaming save has no file to seek in, only the position is known
+    class CountingBuffer : public std::streambuf {
+       public:
+        explicit CountingBuffer(std::ostream& target) : _target(target.rdbuf()) {}
+
+       protected:
+        int_type overflow(int_type ch) override {
+            if (traits_type::eq_int_type(ch, traits_type::eof()))
+                return traits_type::not_eof(ch);
+            if (traits_type::eq_int_type(_target->sputc(traits_type::to_char_type(ch)), traits_type::eof()))
+                return traits_type::eof();
+            _count++;
+            return ch;
+        }
+
+        std::streamsize xsputn(const char* data, std::streamsize size) override {
+            auto written = _target->sputn(data, size);
+            _count += written;
+            return written;
+        }
+
+        pos_type seekoff(off_type offset, std::ios::seekdir dir, std::ios::openmode) override {
+            if (offset != 0 || dir != std::ios::cur)
+                return pos_type(off_type(-1));
+            return pos_type(_count);
+        }
+
+        int sync() override {
+            return _target->pubsync();
+        }
+
+       private:
+        std::streambuf* _target;
+        unsigned long long _count = 0;
+    };
+
+    unsigned long long hashFile(SourceReader& in, unsigned long long size) {
+        std::vector<char> buffer(std::min<unsigned long long>(size, COPY_CHUNK_SIZE));
+        unsigned long long hash = 0;
+        for (unsigned long long position = 0; position < size; position += buffer.size()) {
+            auto length = std::min<unsigned long long>(buffer.size(), size - position);
+            in.readAt(position, buffer.data(), length);
+            hash = hashData(buffer.data(), length, hash);
+        }
+        return hash;
+    }
+
+    bool sameContents(SourceReader& a, SourceReader& b, unsigned long long size) {
+        std::vector<char> bufferA(std::min<unsigned long long>(size, COPY_CHUNK_SIZE));
+        std::vector<char> bufferB(bufferA.size());
+        for (unsigned long long position = 0; position < size; position += bufferA.size()) {
+            auto length = std::min<unsigned long long>(bufferA.size(), size - position);
+            a.readAt(position, bufferA.data(), length);
+            b.readAt(position, bufferB.data(), length);
+            if (std::memcmp(bufferA.data(), bufferB.data(), length) != 0)
+                return false;
+        }
+        return true;
+    }
+}  // namespace
+
 void FileWriter::setFileVersion(int version) {
     _fileVersion = version;
 }
 
-void FileWriter::addFile(const std::string& path, const std::string& targetPath) {
-    if (!std::filesystem::exists(path)) {
-        throw std::runtime_error("File not found");
-    }
-    if (std::filesystem::file_size(path) > ULONG_MAX) {
-        throw std::runtime_error("File is too big.");
+void FileWriter::setFormatVersion(int version) {
+    if (version < FORMAT_VERSION_LEGACY || version > FORMAT_VERSION_STREAMED)
+        throw std::runtime_error("Unsupported format version");
+    if (!_updatePath.empty() && version < FORMAT_VERSION_TRAILING)
+        throw std::runtime_error("Archive opened for update can only be converted to format version 3 or newer");
+    _formatVersion = version;
+}
+
+void FileWriter::setThreadCount(unsigned int threads) {
+    _threadCount = threads;
+}
+
+void FileWriter::setDeduplication(bool enabled) {
+    _deduplicate = enabled;
+}
+
+void FileWriter::setChecksums(bool enabled) {
+    _checksums = enabled;
+}
+
+void FileWriter::setAlignment(unsigned int alignment, unsigned long long minSize) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+        throw std::runtime_error("Alignment must be a power of two");
+
+    _alignment = alignment;
+    _alignmentMinSize = minSize;
+}
+
+void FileWriter::setCompression(int codec, unsigned int chunkSize) {
+    if (codec != CODEC_STORED)
+        getCodec(codec);  // Throws if codec isn't registered
+    if (chunkSize < 1024 || (chunkSize & (chunkSize - 1)) != 0)
+        throw std::runtime_error("Chunk size must be a power of two, at least 1024");
+
+    _codec = codec;
+    _chunkShift = 0;
+    while ((1U << _chunkShift) < chunkSize)
+        _chunkShift++;
+}
+
+void FileWriter::setAccessProfile(const AccessProfile& profile) {
+    _profile.clear();
+    for (auto& record : profile.records()) {
+        auto key = buildPath(splitPath(record.path));
+        std::transform(key.begin(), key.end(), key.begin(), foldCase);
+        _profile.push_back(std::move(key));
     }
+}
 
-    auto parts = splitPath(targetPath);
-    auto fileName = parts[parts.size() - 1];
+void FileWriter::addFile(const std::string& path, const std::string& targetPath, int codec) {
+    std::error_code error;
+    auto fileSize = std::filesystem::file_size(path, error);  // Single stat, also tells if file exists
+    if (error) {
+        throw std::runtime_error("File not found");
+    }
 
-    std::transform(fileName.begin(), fileName.end(), fileName.begin(),
-                   [](unsigned char c) { return std::tolower(c); });  // Convert file name to lower case
+    auto& file = createFile(targetPath, codec);
+    file.originalPath = path;
+    file.size = fileSize;
+}
 
-    EntryData* parent = createDirectories(parts);
-    auto& arr = (parent == nullptr) ? _data : parent->children;
-    createFile(fileName, path, arr);
+void FileWriter::addFile(const std::string& path, const std::string& targetPath) {
+    addFile(path, targetPath, -1);
 }
 
 void FileWriter::addFile(const std::string& path) {
     addFile(path, path);
 }
 
+void FileWriter::addBuffer(std::vector<char> data, const std::string& targetPath, int codec) {
+    auto& file = createFile(targetPath, codec);
+    file.size = data.size();
+    file.buffer = std::make_shared<const std::vector<char>>(std::move(data));
+}
+
+void FileWriter::addBuffer(std::vector<char> data, const std::string& targetPath) {
+    addBuffer(std::move(data), targetPath, -1);
+}
+
+void FileWriter::addStream(std::shared_ptr<std::istream> stream, const std::string& targetPath, int codec) {
+    if (!stream)
+        throw std::runtime_error("Invalid stream");
+
+    auto& file = createFile(targetPath, codec);
+    file.stream = std::move(stream);
+}
+
+void FileWriter::addStream(std::shared_ptr<std::istream> stream, const std::string& targetPath) {
+    addStream(std::move(stream), targetPath, -1);
+}
+
 void FileWriter::save(const std::string& path) {
+    if (!_updatePath.empty())
+        throw std::runtime_error("Archive opened for update is written with update()");
+
+    std::vector<EntryData*> entries;
+    collectEntries(entries);
+    for (auto id : _files) {
+        if (_formatVersion >= FORMAT_VERSION_FROZEN)
+            break;
+        if ((entries[id]->codec < 0 ? _codec : entries[id]->codec) != CODEC_STORED)
+            throw std::runtime_error("Compression requires format version 2 or newer");
+        if (entries[id]->size > 0xFFFFFFFF)
+            throw std::runtime_error("File is too big. Files over 4 GB require format version 2 or newer");
+    }
+
     std::ofstream of(path, std::ios::out | std::ios::binary);
+    if (!of.is_open())
+        throw std::runtime_error("Unable to create file");
 
     of << "HONK";                                         // Magic header
-    of << (BYTE)0;                                        // Format version
+    of << (BYTE)_formatVersion;                           // Format version
     of.write(reinterpret_cast<char*>(&_fileVersion), 4);  // File content version
 
-    writeEntryTable(of);
-    // writeMetadata(of); // Will be added in version 2
-    writeFilesData(of);
+    unsigned long long end = 0;
+    if (_formatVersion >= FORMAT_VERSION_TRAILING) {
+        char header[TRAILING_HEADER_SIZE] = {};
+        of.write(header, TRAILING_HEADER_SIZE - 9);  // Filled once index position is known
+        _fileSectionBegin = 0;
+        writeFilesData(of, path);
+        end = writeTrailingIndex(of);
+    } else {
+        // Table size doesn't depend on offsets, so it's written twice: as placeholder
+        // and once file data is written and final offsets and sizes are known
+        auto tableBegin = of.tellp();
+        for (int pass = 0; pass < 2; pass++) {
+            of.seekp(tableBegin);
+            if (_formatVersion >= FORMAT_VERSION_FROZEN)
+                writeFrozenIndex(of);
+            else
+                writeEntryTable(of);
+            if (_formatVersion > 0)
+                writeMetadata(of);
+
+            if (pass == 0) {
+                _fileSectionBegin = of.tellp();
+                writeFilesData(of, path);
+                end = of.tellp();
+            }
+        }
+    }
+
+    of.close();
+    if (!of)
+        throw std::runtime_error("Unable to write file");
+    std::filesystem::resize_file(path, end);  // Drop leftovers of entries rewritten without compression
+}
+
+void FileWriter::save(std::ostream& out) {
+    if (!_updatePath.empty())
+        throw std::runtime_error("Archive opened for update is written with update()");
+    if (_formatVersion < FORMAT_VERSION_STREAMED)
+        throw std::runtime_error("Streaming save requires format version 5 or newer");
+
+    CountingBuffer buffer(out);
+    std::ostream of(&buffer);
+    of << "HONK";
+    of << (BYTE)_formatVersion;
+    of.write(reinterpret_cast<char*>(&_fileVersion), 4);
+
+    char header[TRAILING_HEADER_SIZE] = {};
+    of.write(header, TRAILING_HEADER_SIZE - 9);  // Index is found through the footer
+    _fileSectionBegin = 0;
+    writeFilesData(of, "");
+    writeTrailingIndex(of);
+
+    of.flush();
+    if (!of || !out)
+        throw std::runtime_error("Unable to write file");
+}
+
+void FileWriter::openForUpdate(const std::string& path) {
+    FileReader reader(path);
+
+    _data.clear();
+    _files.clear();
+    _filePaths.clear();
+    _dirPaths.clear();
+    _idCounter = 0;
+    _data.reserve(reader._rootCount);
+
+    // Nodes are in breadth-first order, so a parent is always created before its children and
+    // reserving children arrays keeps pointers to created entries valid
+    std::vector<EntryData*> created(reader._nodeCount);
+    std::vector<std::string> paths(reader._nodeCount);
+    for (unsigned int i = 0; i < reader._nodeCount; i++) {
+        auto& node = reader._nodes[i];
+        auto& array = (node.parent == NO_ENTRY) ? _data : created[node.parent]->children;
+        array.emplace_back();
+
+        auto& entry = array.back();
+        created[i] = &entry;
+        entry.id = _idCounter++;
+        entry.name = std::string(reader.nodeName(&node));
+        entry.type = node.type;
+        paths[i] = (node.parent == NO_ENTRY) ? entry.name : paths[node.parent] + "\\" + entry.name;
+
+        if (node.type == ENTRYDATA_TYPE_DIR) {
+            entry.children.reserve(node.childCount);
+            _dirPaths.insert(paths[i]);
+            continue;
+        }
+
+        entry.inArchive = true;
+        entry.offset = reader._fileSectionBegin + node.offset;  // Trailing index archives use absolute offsets
+        entry.size = node.size;
+        entry.storedCodec = node.codec;
+        entry.chunkShift = node.chunkShift;
+        entry.storedSize = (node.codec == CODEC_STORED) ? node.size : node.storedSize;
+        entry.checksum = node.checksum;
+        entry.hasChecksum = (node.flags & ENTRY_FLAG_CHECKSUM) != 0;
+        entry.trailingTable = (node.flags & ENTRY_FLAG_TRAILING_TABLE) != 0;
+        if (entry.size > 0 && entry.offset < TRAILING_HEADER_SIZE)
+            throw std::runtime_error("File is corrupted. Entry overlaps the header.");
+        _files.push_back(entry.id);
+        _filePaths.emplace(paths[i], array.size() - 1);
+    }
+
+    _updatePath = path;
+    _archiveVersion = reader._fileVersion;
+    _formatVersion = std::max(reader._fileVersion, FORMAT_VERSION_TRAILING);
+    _fileVersion = reader.contentVersion() + 1;
+}
+
+void FileWriter::update() {
+    if (_updatePath.empty())
+        throw std::runtime_error("No archive is opened for update");
+
+    std::ofstream of(_updatePath, std::ios::in | std::ios::out | std::ios::binary);
+    if (!of.is_open())
+        throw std::runtime_error("Unable to open file");
+
+    // Data already in the archive stays where it is, new data and index go to the end.
+    // Header is rewritten last, until then the archive keeps pointing at the previous index
+    of.seekp(0, std::ios::end);
+    _fileSectionBegin = 0;
+    writeFilesData(of, _updatePath);
+    auto end = writeTrailingIndex(of);
+    if (_formatVersion >= FORMAT_VERSION_STREAMED && _archiveVersion < FORMAT_VERSION_STREAMED) {
+        // Streamed archives don't rewrite the header, except once to make readers look for the footer
+        char padding[TRAILING_HEADER_SIZE] = {};
+        of.flush();
+        of.seekp(0);
+        of << "HONK";
+        of << (BYTE)_formatVersion;
+        of.write(reinterpret_cast<char*>(&_fileVersion), 4);
+        of.write(padding, TRAILING_HEADER_SIZE - 9);
+    }
+
+    of.close();
+    if (!of)
+        throw std::runtime_error("Unable to write file");
+    std::filesystem::resize_file(_updatePath, end);
+    _archiveVersion = _formatVersion;
+
+    std::vector<EntryData*> entries;
+    collectEntries(entries);
+    for (auto id : _files) {
+        entries[id]->inArchive = true;
+    }
 }
 
 FileWriter::EntryData* FileWriter::createDirectories(const std::vector<std::string>& path) {
     EntryData* parent = nullptr;
+    std::string key;
 
     for (size_t i = 0; i < path.size() - 1; i++) {
         auto& arr = (parent == nullptr) ? _data : parent->children;
         auto name = path[i];
-        std::transform(name.begin(), name.end(), name.begin(),
-                       [](unsigned char c) { return std::tolower(c); });  // Convert directory name to lower case
+        std::transform(name.begin(), name.end(), name.begin(), foldCase);  // Convert directory name to lower case
+        key += (i == 0) ? name : "\\" + name;
 
         bool found = false;
         for (auto& entry : arr) {
             if (entry.name == name) {
+                if (entry.type != ENTRYDATA_TYPE_DIR)
+                    throw std::runtime_error("Path conflicts with existing file");
                 found = true;
                 parent = &entry;
                 break;
@@ -72,6 +405,7 @@ FileWriter::EntryData* FileWriter::createDirectories(const std::vector<std::stri
         dir.name = name;
         dir.type = ENTRYDATA_TYPE_DIR;
         dir.id = _idCounter++;
+        _dirPaths.insert(key);
 
         parent = &(*(arr.end() - 1));
     }
@@ -79,25 +413,67 @@ FileWriter::EntryData* FileWriter::createDirectories(const std::vector<std::stri
     return parent;
 }
 
-void FileWriter::createFile(const std::string& filename, const std::string& realPath, std::vector<EntryData>& parentArray) {
+FileWriter::EntryData& FileWriter::createFile(const std::string& targetPath, int codec) {
+    auto parts = splitPath(targetPath);
+    if (parts.empty())
+        throw std::runtime_error("Invalid target path");
+    auto fileName = parts[parts.size() - 1];
+
+    std::transform(fileName.begin(), fileName.end(), fileName.begin(), foldCase);  // Convert file name to lower case
+    auto key = buildPath(parts);
+    std::transform(key.begin(), key.end(), key.begin(), foldCase);
+
+    EntryData* parent = createDirectories(parts);
+    auto& parentArray = (parent == nullptr) ? _data : parent->children;
+
+    if (_dirPaths.count(key) > 0)
+        throw std::runtime_error("Path conflicts with existing directory");
+
+    // File added to the same path again replaces the previous one
+    auto [it, inserted] = _filePaths.emplace(key, parentArray.size());
+    if (!inserted) {
+        auto& entry = parentArray[it->second];
+        entry.originalPath.clear();
+        entry.buffer.reset();
+        entry.stream.reset();
+        entry.streamRead = false;
+        entry.size = 0;
+        entry.codec = codec;
+        entry.inArchive = false;
+        return entry;
+    }
+
     parentArray.emplace_back();
 
     auto& file = *(parentArray.end() - 1);
-    file.name = filename;
+    file.name = fileName;
 
     file.id = _idCounter++;
     file.type = ENTRYDATA_TYPE_FILE;
-    file.originalPath = realPath;
+    file.codec = codec;
 
-    uintmax_t fileSize = std::filesystem::file_size(realPath);
-    file.offset = _fileOffsetCounter;
-    file.size = fileSize;
+    _files.push_back(file.id);
+    return file;
+}
 
-    _fileOffsetCounter += fileSize;
-    _files.push_back(realPath);
+void FileWriter::collectEntries(std::vector<EntryData*>& entries) {
+    entries.assign(_idCounter, nullptr);
+
+    std::queue<EntryData*> queue;
+    for (auto& entry : _data) {
+        queue.push(&entry);
+    }
+    while (!queue.empty()) {
+        auto* entry = queue.front();
+        queue.pop();
+        entries[entry->id] = entry;
+        for (auto& child : entry->children) {
+            queue.push(&child);
+        }
+    }
 }
 
-void FileWriter::writeEntryTable(std::ofstream& of) {
+void FileWriter::writeEntryTable(std::ostream& of) {
     int totalEntries = _idCounter;
     of.write(reinterpret_cast<char*>(&totalEntries), 4);
 
@@ -119,7 +495,7 @@ void FileWriter::writeEntryTable(std::ofstream& of) {
     }
 }
 
-void FileWriter::writeEntry(std::ofstream& of, EntryData* data) {
+void FileWriter::writeEntry(std::ostream& of, EntryData* data) {
     auto childAmount = data->children.size();
 
     of.write(reinterpret_cast<char*>(&data->id), 4);
@@ -133,30 +509,692 @@ void FileWriter::writeEntry(std::ofstream& of, EntryData* data) {
         }
     }
     if (data->type == ENTRYDATA_TYPE_FILE) {
+        unsigned int size = data->size;  // Legacy table keeps 32-bit sizes, checked in save()
         of.write(reinterpret_cast<char*>(&data->offset), 8);
-        of.write(reinterpret_cast<char*>(&data->size), 4);
+        of.write(reinterpret_cast<char*>(&size), 4);
+    }
+}
+
+unsigned long long FileWriter::writeFrozenIndex(std::ostream& of, bool trailing) {
+    std::vector<const EntryData*> order;
+    for (auto& entry : _data) {
+        order.push_back(&entry);
+    }
+
+    IndexHeader header = {};
+    header.entrySize = sizeof(IndexEntry);
+    header.rootCount = order.size();
+
+    std::vector<IndexEntry> entries;
+    std::vector<unsigned long long> hashes;
+    std::string names;
+    std::unordered_map<std::string, unsigned int> nameOffsets;
+    entries.reserve(_idCounter);
+
+    // Breadth-first, same order as the legacy entry table
+    for (size_t i = 0; i < order.size(); i++) {
+        auto* data = order[i];
+        IndexEntry entry = {};
+        entry.parent = NO_ENTRY;  // Assigned below, once children ranges are known
+
+        auto [it, inserted] = nameOffsets.emplace(data->name, names.size());
+        if (inserted)
+            names += data->name;
+        entry.name = it->second;
+        entry.nameLength = data->name.size();
+        entry.type = data->type;
+
+        if (data->type == ENTRYDATA_TYPE_FILE) {
+            entry.offset = data->offset;
+            entry.size = data->size;
+            entry.codec = data->storedCodec;
+            entry.chunkShift = data->chunkShift;
+            entry.storedSize = data->storedSize;
+            entry.checksum = data->checksum;
+            entry.flags = (data->hasChecksum ? ENTRY_FLAG_CHECKSUM : 0) | (data->trailingTable ? ENTRY_FLAG_TRAILING_TABLE : 0);
+        }
+        entry.firstChild = order.size();
+        entry.childCount = data->children.size();
+        for (auto& child : data->children) {
+            order.push_back(&child);
+        }
+        entries.push_back(entry);
+    }
+
+    for (unsigned int i = 0; i < entries.size(); i++) {
+        for (auto child = entries[i].firstChild; child < entries[i].firstChild + entries[i].childCount; child++) {
+            entries[child].parent = i;
+        }
+    }
+
+    unsigned int slotCount = 16;
+    while (slotCount < entries.size() * 2)
+        slotCount <<= 1;
+    std::vector<IndexSlot> slots(slotCount, IndexSlot{0, NO_ENTRY, 0});
+
+    hashes.resize(entries.size());
+    for (unsigned int i = 0; i < entries.size(); i++) {
+        auto& entry = entries[i];
+        auto seed = (entry.parent == NO_ENTRY) ? hashString("") : hashString("\\", hashes[entry.parent]);
+        hashes[i] = hashFolded(std::string_view(names).substr(entry.name, entry.nameLength), seed);
+
+        auto slot = hashes[i] & (slotCount - 1);
+        while (slots[slot].entry != NO_ENTRY)
+            slot = (slot + 1) & (slotCount - 1);
+        slots[slot] = IndexSlot{hashes[i], i, 0};
+    }
+
+    header.entryCount = entries.size();
+    header.slotCount = slotCount;
+    header.namesSize = names.size();
+    names.resize((names.size() + 7) & ~7ULL, '\0');
+
+    unsigned long long indexSize = sizeof(IndexHeader) + entries.size() * sizeof(IndexEntry) + slots.size() * sizeof(IndexSlot) + names.size();
+    if (!trailing) {
+        char padding[FROZEN_INDEX_OFFSET] = {};
+        of.write(padding, FROZEN_INDEX_OFFSET - 9);  // Align index to 8 bytes
+        of.write(reinterpret_cast<char*>(&indexSize), 8);
     }
+    of.write(reinterpret_cast<char*>(&header), sizeof(IndexHeader));
+    of.write(reinterpret_cast<char*>(entries.data()), entries.size() * sizeof(IndexEntry));
+    of.write(reinterpret_cast<char*>(slots.data()), slots.size() * sizeof(IndexSlot));
+    of.write(names.data(), names.size());
+    return indexSize;
 }
 
-void FileWriter::writeMetadata(std::ofstream& of) {
+unsigned long long FileWriter::writeTrailingIndex(std::ostream& of) {
+    unsigned long long indexOffset = of.tellp();
+    char padding[8] = {};
+    of.write(padding, (8 - indexOffset % 8) % 8);  // Index is used in place from the mapping, align it
+    indexOffset = of.tellp();
+
+    unsigned long long indexSize = (_formatVersion >= FORMAT_VERSION_LAZY) ? writeLazyIndex(of, indexOffset) : writeFrozenIndex(of, true);
+    writeMetadata(of);
+    if (_formatVersion >= FORMAT_VERSION_STREAMED) {
+        // Nothing is rewritten, the last footer in the file is the current one
+        StreamFooter footer = {indexOffset, indexSize, _fileVersion, {'H', 'O', 'N', 'K'}};
+        of.write(reinterpret_cast<char*>(&footer), sizeof(StreamFooter));
+        return of.tellp();
+    }
+    unsigned long long end = of.tellp();
+
+    of.flush();  // Index must be complete before the header points at it
+    of.seekp(0);
+    of << "HONK";
+    of << (BYTE)_formatVersion;
+    of.write(reinterpret_cast<char*>(&_fileVersion), 4);
+    of.write(padding, FROZEN_INDEX_OFFSET - 9);
+    of.write(reinterpret_cast<char*>(&indexOffset), 8);
+    of.write(reinterpret_cast<char*>(&indexSize), 8);
+    return end;
+}
+
+unsigned long long FileWriter::writeLazyIndex(std::ostream& of, unsigned long long indexOffset) {
+    struct Node {
+        const EntryData* data;
+        unsigned int parent;
+        unsigned int firstChild;
+        unsigned int childCount;
+        unsigned long long namesSize;  // Of its children, which make up its block
+    };
+
+    // Breadth-first, children sorted by name so that a loaded directory can be binary searched
+    std::vector<Node> order;
+    auto addChildren = [&](const std::vector<EntryData>& children, unsigned int parent) {
+        std::vector<const EntryData*> sorted;
+        for (auto& child : children) {
+            sorted.push_back(&child);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const EntryData* a, const EntryData* b) { return a->name < b->name; });
+
+        unsigned long long namesSize = 0;
+        for (auto* child : sorted) {
+            order.push_back(Node{child, parent, 0, 0, 0});
+            namesSize += child->name.size();
+        }
+        return namesSize;
+    };
+
+    LazyIndexHeader header = {};
+    header.entrySize = sizeof(IndexEntry);
+    auto rootNamesSize = addChildren(_data, NO_ENTRY);
+    header.rootCount = order.size();
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i].firstChild = order.size();
+        order[i].childCount = order[i].data->children.size();
+        order[i].namesSize = addChildren(order[i].data->children, i);
+    }
+    header.entryCount = order.size();
+    header.rootBlockSize = header.rootCount * sizeof(IndexEntry) + rootNamesSize;
+
+    // Block positions have to be known before the entries pointing at them are written
+    std::vector<unsigned long long> blockOffsets(order.size(), 0);
+    auto position = indexOffset + sizeof(LazyIndexHeader) + header.rootBlockSize;
+    header.namesSize = rootNamesSize;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (order[i].childCount == 0)
+            continue;
+        position = (position + 7) & ~7ULL;
+        blockOffsets[i] = position;
+        position += order[i].childCount * sizeof(IndexEntry) + order[i].namesSize;
+        header.namesSize += order[i].namesSize;
+    }
+
+    auto writeBlock = [&](unsigned int first, unsigned int count) {
+        std::vector<IndexEntry> entries(count);
+        std::string names;
+        for (unsigned int i = 0; i < count; i++) {
+            auto& node = order[first + i];
+            auto* data = node.data;
+            auto& entry = entries[i];
+            entry.parent = node.parent;
+            entry.name = names.size();
+            entry.nameLength = data->name.size();
+            entry.type = data->type;
+            names += data->name;
+
+            if (data->type == ENTRYDATA_TYPE_FILE) {
+                entry.offset = data->offset;
+                entry.size = data->size;
+                entry.codec = data->storedCodec;
+                entry.chunkShift = data->chunkShift;
+                entry.storedSize = data->storedSize;
+                entry.checksum = data->checksum;
+                entry.flags = (data->hasChecksum ? ENTRY_FLAG_CHECKSUM : 0) | (data->trailingTable ? ENTRY_FLAG_TRAILING_TABLE : 0);
+            } else if (node.childCount > 0) {
+                entry.offset = blockOffsets[first + i];
+                entry.storedSize = node.childCount * sizeof(IndexEntry) + node.namesSize;
+            }
+            entry.firstChild = node.firstChild;
+            entry.childCount = node.childCount;
+        }
+        of.write(reinterpret_cast<char*>(entries.data()), entries.size() * sizeof(IndexEntry));
+        of.write(names.data(), names.size());
+    };
+
+    of.write(reinterpret_cast<char*>(&header), sizeof(LazyIndexHeader));
+    writeBlock(0, header.rootCount);
+    for (size_t i = 0; i < order.size(); i++) {
+        if (order[i].childCount == 0)
+            continue;
+        char padding[8] = {};
+        of.write(padding, blockOffsets[i] - of.tellp());
+        writeBlock(order[i].firstChild, order[i].childCount);
+    }
+    return position - indexOffset;
+}
+
+void FileWriter::writeMetadata(std::ostream& of) {
     auto zero = 0;
     of.write(reinterpret_cast<char*>(&zero), 4);
     of.write(reinterpret_cast<char*>(&zero), 4);
 }
 
-void FileWriter::writeFilesData(std::ofstream& of) {
-    for (auto& filename : _files) {
-        writeFileData(of, filename);
+void FileWriter::orderByProfile() {
+    // Target paths of files, built the same way as profile keys
+    std::unordered_map<std::string, int> ids;
+    std::vector<std::pair<const EntryData*, std::string>> pending;
+    for (auto& entry : _data) {
+        pending.emplace_back(&entry, entry.name);
+    }
+    while (!pending.empty()) {
+        auto [entry, path] = std::move(pending.back());
+        pending.pop_back();
+        if (entry->type == ENTRYDATA_TYPE_FILE)
+            ids.emplace(path, entry->id);
+        for (auto& child : entry->children) {
+            pending.emplace_back(&child, path + "\\" + child.name);
+        }
+    }
+
+    // Files read together end up next to each other in the order they were read, the rest keep the order they were added in
+    std::vector<size_t> rank(_idCounter, SIZE_MAX);
+    for (size_t i = 0; i < _profile.size(); i++) {
+        auto it = ids.find(_profile[i]);
+        if (it != ids.end() && rank[it->second] == SIZE_MAX)
+            rank[it->second] = i;
     }
+    std::stable_sort(_files.begin(), _files.end(), [&rank](int a, int b) { return rank[a] < rank[b]; });
 }
 
-void FileWriter::writeFileData(std::ofstream& of, const std::string& filename) {
-    std::ifstream file(filename, std::ios::binary);
-    std::vector<char> buffer(1024);
+void FileWriter::findDuplicates(const std::vector<EntryData*>& entries, unsigned int workers, std::vector<size_t>& duplicateOf) {
+    // Only files sharing size and codec with another one have to be hashed
+    using SizeKey = std::pair<unsigned long long, int>;
+    std::map<SizeKey, std::vector<size_t>> bySize;
+    for (size_t i = 0; i < _files.size(); i++) {
+        auto& file = *entries[_files[i]];
+        if (file.size > 0 && !file.inArchive && !file.stream)
+            bySize[SizeKey(file.size, file.codec < 0 ? _codec : file.codec)].push_back(i);
+    }
+
+    // Same source added several times needs no reading at all
+    std::vector<size_t> candidates;
+    std::unordered_map<std::string, size_t> firstWithPath;
+    for (auto& [key, files] : bySize) {
+        if (files.size() < 2)
+            continue;
+        firstWithPath.clear();
+        for (auto i : files) {
+            if (entries[_files[i]]->buffer) {
+                candidates.push_back(i);
+                continue;
+            }
+            auto [it, inserted] = firstWithPath.emplace(entries[_files[i]]->originalPath, i);
+            if (inserted)
+                candidates.push_back(i);
+            else
+                duplicateOf[i] = it->second;
+        }
+    }
+
+    std::vector<unsigned long long> hashes(candidates.size());
+    parallelFor(candidates.size(), workers, [&](size_t i) {
+        auto& file = *entries[_files[candidates[i]]];
+        SourceReader in(file.originalPath, file.buffer.get(), file.size);
+        hashes[i] = hashFile(in, file.size);
+    });
 
-    while (!file.eof()) {
-        file.read(buffer.data(), buffer.size());
-        auto actualRead = file.gcount();
-        of.write(buffer.data(), actualRead);
+    // Hashes only point at possible duplicates, contents are compared before sharing data
+    using ContentKey = std::tuple<unsigned long long, int, unsigned long long>;
+    std::map<ContentKey, size_t> firstWithContent;
+    std::vector<std::pair<size_t, size_t>> matches;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        auto& file = *entries[_files[candidates[i]]];
+        ContentKey key(file.size, file.codec < 0 ? _codec : file.codec, hashes[i]);
+        auto [it, inserted] = firstWithContent.emplace(key, candidates[i]);
+        if (!inserted)
+            matches.emplace_back(candidates[i], it->second);
     }
+
+    std::vector<char> confirmed(matches.size(), 0);
+    parallelFor(matches.size(), workers, [&](size_t i) {
+        auto& file = *entries[_files[matches[i].first]];
+        auto& original = *entries[_files[matches[i].second]];
+        SourceReader a(file.originalPath, file.buffer.get(), file.size);
+        SourceReader b(original.originalPath, original.buffer.get(), original.size);
+        confirmed[i] = sameContents(a, b, file.size);
+    });
+    for (size_t i = 0; i < matches.size(); i++) {
+        if (confirmed[i])
+            duplicateOf[matches[i].first] = matches[i].second;
+    }
+
+    // Files added from the same source as a confirmed duplicate follow it to the original
+    for (size_t i = 0; i < duplicateOf.size(); i++) {
+        if (duplicateOf[i] != NOT_DUPLICATE && duplicateOf[duplicateOf[i]] != NOT_DUPLICATE)
+            duplicateOf[i] = duplicateOf[duplicateOf[i]];
+    }
+}
+
+void FileWriter::writeFilesData(std::ostream& of, const std::string& path) {
+    std::vector<EntryData*> entries;
+    collectEntries(entries);
+
+    // Second handle to the same file, big stored files are copied through it without passing user space.
+    // Streaming save has none, all data goes through the stream in order
+    OutputFile out;
+    if (!path.empty())
+        out.open(path, false);
+
+    if (!_profile.empty())
+        orderByProfile();
+
+    auto workers = _threadCount > 0 ? _threadCount : std::max(1U, std::thread::hardware_concurrency());
+    std::vector<size_t> duplicateOf(_files.size(), NOT_DUPLICATE);
+    if (_deduplicate)
+        findDuplicates(entries, workers, duplicateOf);
+
+    // Every file is split into jobs which worker threads read (and compress) in parallel,
+    // while this thread writes finished jobs strictly in order
+    std::vector<DataJob> jobs;
+    std::vector<std::unique_ptr<DataSource>> sources;
+    std::vector<std::shared_ptr<Codec>> codecs(_files.size());
+    bool checksum = _checksums && _formatVersion >= FORMAT_VERSION_FROZEN;
+    for (size_t i = 0; i < _files.size(); i++) {
+        if (duplicateOf[i] != NOT_DUPLICATE || entries[_files[i]]->inArchive)
+            continue;
+
+        auto& file = *entries[_files[i]];
+        auto codecId = (file.codec < 0) ? _codec : file.codec;
+        if (codecId != CODEC_STORED)
+            codecs[i] = getCodec(codecId);
+        if (file.stream)
+            continue;  // Size is unknown until it is read, this thread reads it when its turn comes
+
+        unsigned long long chunkSize = (codecId == CODEC_STORED) ? COPY_CHUNK_SIZE : (1ULL << _chunkShift);
+        unsigned long long size = file.size;
+        bool copied = out.isOpen() && !file.buffer && codecId == CODEC_STORED && size >= COPY_CHUNK_SIZE;
+        if ((copied && !checksum) || size == 0)
+            continue;
+
+        DataSource* source = nullptr;
+        if (!file.buffer) {
+            sources.push_back(std::make_unique<DataSource>());
+            source = sources.back().get();
+            source->pendingJobs = (size + chunkSize - 1) / chunkSize;
+        }
+        for (unsigned long long position = 0; position < size; position += chunkSize) {
+            jobs.push_back(DataJob{&file, source, codecs[i].get(), position, std::min(chunkSize, size - position), checksum, copied});
+        }
+    }
+
+    DataPipeline pipeline(jobs, workers * 4);
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < workers; i++) {
+        threads.emplace_back([&pipeline]() { pipeline.work(); });
+    }
+
+    try {
+        size_t nextJob = 0;
+        for (size_t i = 0; i < _files.size(); i++) {
+            auto& file = *entries[_files[i]];
+            if (file.inArchive)
+                continue;
+            if (duplicateOf[i] != NOT_DUPLICATE) {
+                auto& original = *entries[_files[duplicateOf[i]]];  // Always written earlier
+                file.offset = original.offset;
+                file.storedCodec = original.storedCodec;
+                file.chunkShift = original.chunkShift;
+                file.storedSize = original.storedSize;
+                file.checksum = original.checksum;
+                file.hasChecksum = original.hasChecksum;
+                file.trailingTable = original.trailingTable;
+                continue;
+            }
+
+            // Alignment is absolute, so entry data can be read with direct I/O or mapped at page boundary
+            unsigned long long position = of.tellp();
+            bool aligned = file.stream ? _alignmentMinSize == 0 : (file.size > 0 && file.size >= _alignmentMinSize);
+            if (_alignment > 1 && aligned && position % _alignment != 0) {
+                std::vector<char> padding(_alignment - position % _alignment, '\0');
+                of.write(padding.data(), padding.size());
+            }
+
+            file.offset = (unsigned long long)of.tellp() - _fileSectionBegin;
+            file.storedCodec = CODEC_STORED;
+            file.chunkShift = 0;
+            file.storedSize = file.size;
+            file.checksum = 0;
+            file.hasChecksum = checksum;
+            file.trailingTable = false;
+            if (file.stream) {
+                writeStreamData(of, file, codecs[i].get());
+                continue;
+            }
+
+            auto firstJob = nextJob;
+            while (nextJob < jobs.size() && jobs[nextJob].file == &file)
+                nextJob++;
+            writeFileData(of, out, file, codecs[i].get(), pipeline, firstJob, nextJob);
+        }
+    } catch (...) {
+        pipeline.stop();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        throw;
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void FileWriter::writeFileData(std::ostream& of, OutputFile& out, EntryData& file, Codec* codec, DataPipeline& pipeline, size_t firstJob, size_t lastJob) {
+    // Chunk checksums are merged in order, jobs are empty if checksums are disabled
+    if (codec == nullptr && out.isOpen() && !file.buffer && file.size >= COPY_CHUNK_SIZE) {
+        for (auto i = firstJob; i < lastJob; i++) {
+            file.checksum = crc32cCombine(file.checksum, pipeline.take(i).checksum, pipeline.jobSize(i));
+        }
+        copyFileData(of, out, file);
+        return;
+    }
+    if (codec == nullptr) {
+        for (auto i = firstJob; i < lastJob; i++) {
+            auto result = pipeline.take(i);
+            of.write(result.data.data(), result.data.size());
+            file.checksum = crc32cCombine(file.checksum, result.checksum, pipeline.jobSize(i));
+        }
+        return;
+    }
+
+    auto chunkCount = lastJob - firstJob;
+    std::vector<unsigned int> table(chunkCount);
+    bool compressed = false;
+    bool trailingTable = _formatVersion >= FORMAT_VERSION_STREAMED;
+
+    if (chunkCount == 1 || trailingTable) {
+        // Chunks are written as soon as they are ready, the table is known by the time it's needed
+        for (auto i = firstJob; i < lastJob; i++) {
+            auto result = pipeline.take(i);
+            table[i - firstJob] = result.data.size();
+            compressed |= result.compressed;
+            file.checksum = crc32cCombine(file.checksum, result.checksum, pipeline.jobSize(i));
+            if (compressed && !trailingTable)
+                of.write(reinterpret_cast<char*>(table.data()), 4);  // Single chunk
+            of.write(result.data.data(), result.data.size());
+        }
+        if (compressed && trailingTable)
+            of.write(reinterpret_cast<char*>(table.data()), chunkCount * 4);
+        // Uncompressed chunks hold original data, nothing compressed means the file is stored as is
+    } else {
+        auto tableBegin = of.tellp();
+        of.write(reinterpret_cast<char*>(table.data()), chunkCount * 4);  // Placeholder for chunk sizes
+
+        for (auto i = firstJob; i < lastJob; i++) {
+            auto result = pipeline.take(i);
+            of.write(result.data.data(), result.data.size());
+            table[i - firstJob] = result.data.size();
+            compressed |= result.compressed;
+            file.checksum = crc32cCombine(file.checksum, result.checksum, pipeline.jobSize(i));
+        }
+
+        if (!compressed) {
+            // Nothing compressed, store whole file as is
+            of.seekp(tableBegin);
+            if (file.buffer)
+                of.write(file.buffer->data(), file.size);
+            else
+                copyFileData(of, out, file);
+            return;
+        }
+
+        auto end = of.tellp();
+        of.seekp(tableBegin);
+        of.write(reinterpret_cast<char*>(table.data()), chunkCount * 4);
+        of.seekp(end);
+    }
+
+    if (compressed) {
+        file.storedCodec = codec->id();
+        file.chunkShift = _chunkShift;
+        file.storedSize = (unsigned long long)of.tellp() - _fileSectionBegin - file.offset;
+        file.trailingTable = trailingTable;
+    }
+}
+
+void FileWriter::writeStreamData(std::ostream& of, EntryData& file, Codec* codec) {
+    if (file.streamRead)
+        throw std::runtime_error("Stream was already saved");
+    file.streamRead = true;
+
+    // Read and compressed on this thread. Older versions need the table before the chunks, so there
+    // compressed chunks wait in memory until the stream ends
+    auto& in = *file.stream;
+    bool trailingTable = _formatVersion >= FORMAT_VERSION_STREAMED;
+    std::vector<char> buffer((codec == nullptr) ? COPY_CHUNK_SIZE : (1ULL << _chunkShift));
+    std::vector<std::vector<char>> chunks;
+    std::vector<unsigned int> table;
+    unsigned long long kept = 0;
+    bool compressed = false;
+    file.size = 0;
+    while (in) {
+        in.read(buffer.data(), buffer.size());
+        size_t length = in.gcount();
+        if (length == 0)
+            break;
+        if (file.hasChecksum)
+            file.checksum = crc32c(buffer.data(), length, file.checksum);
+        file.size += length;
+        if (codec == nullptr) {
+            of.write(buffer.data(), length);
+            continue;
+        }
+
+        std::vector<char> packed(length);
+        auto packedSize = codec->compress(buffer.data(), length, packed.data(), length - 1);
+        if (packedSize == 0) {
+            std::memcpy(packed.data(), buffer.data(), length);  // Doesn't compress, keep as is
+        } else {
+            packed.resize(packedSize);
+            compressed = true;
+        }
+        table.push_back(packed.size());
+        if (trailingTable) {
+            of.write(packed.data(), packed.size());
+            continue;
+        }
+
+        kept += packed.size();
+        if (kept > STREAM_BUFFER_LIMIT)
+            throw std::runtime_error("Stream is too big. Compressed streams over 256 MB require format version 5 or newer");
+        chunks.push_back(std::move(packed));
+    }
+    if (in.bad())
+        throw std::runtime_error("Unable to read stream");
+    if (_formatVersion < FORMAT_VERSION_FROZEN && file.size > 0xFFFFFFFF)
+        throw std::runtime_error("File is too big. Files over 4 GB require format version 2 or newer");
+
+    if (compressed && !trailingTable)
+        of.write(reinterpret_cast<char*>(table.data()), table.size() * 4);
+    for (auto& chunk : chunks) {
+        of.write(chunk.data(), chunk.size());
+    }
+    if (compressed && trailingTable)
+        of.write(reinterpret_cast<char*>(table.data()), table.size() * 4);
+
+    file.storedSize = file.size;
+    if (compressed) {
+        file.storedCodec = codec->id();
+        file.chunkShift = _chunkShift;
+        file.storedSize = (unsigned long long)of.tellp() - _fileSectionBegin - file.offset;
+        file.trailingTable = trailingTable;
+    }
+}
+
+FileWriter::DataPipeline::DataPipeline(const std::vector<DataJob>& jobs, size_t window)
+    : _jobs(jobs), _results(window) {
+}
+
+void FileWriter::DataPipeline::work() {
+    while (true) {
+        size_t job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this]() {
+                return _stopped || _claimed >= _jobs.size() || _claimed < _taken + _results.size();
+            });
+            if (_stopped || _claimed >= _jobs.size())
+                return;
+            job = _claimed++;
+        }
+
+        DataResult result;
+        try {
+            process(_jobs[job], result);
+        } catch (...) {
+            result.error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _results[job % _results.size()] = std::move(result);
+            _results[job % _results.size()].ready = true;
+        }
+        _condition.notify_all();
+    }
+}
+
+FileWriter::DataResult FileWriter::DataPipeline::take(size_t job) {
+    DataResult result;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto& slot = _results[job % _results.size()];
+        _condition.wait(lock, [&slot]() { return slot.ready; });
+
+        result = std::move(slot);
+        slot = DataResult();
+        _taken++;
+    }
+    _condition.notify_all();
+
+    if (result.error)
+        std::rethrow_exception(result.error);
+    return result;
+}
+
+unsigned long long FileWriter::DataPipeline::jobSize(size_t job) const {
+    return _jobs[job].size;
+}
+
+void FileWriter::DataPipeline::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+    }
+    _condition.notify_all();
+}
+
+void FileWriter::DataPipeline::process(const DataJob& job, DataResult& result) {
+    result.data.resize(job.size);
+    if (job.source == nullptr) {
+        std::memcpy(result.data.data(), job.file->buffer->data() + job.position, job.size);
+    } else {
+        auto& source = *job.source;
+        {
+            std::lock_guard<std::mutex> lock(source.mutex);
+            if (!source.file.isOpen()) {
+                source.file.open(job.file->originalPath);
+                if (source.file.size() != job.file->size) {
+                    source.file.close();
+                    throw std::runtime_error("File was changed while saving");
+                }
+            }
+        }
+        source.file.readAt(job.position, result.data.data(), job.size);
+
+        std::lock_guard<std::mutex> lock(source.mutex);
+        if (--source.pendingJobs == 0)
+            source.file.close();
+    }
+    if (job.checksum)
+        result.checksum = crc32c(result.data.data(), job.size);
+    if (job.copied)
+        result.data = std::vector<char>();
+    if (job.codec == nullptr)
+        return;
+
+    std::vector<char> packed(job.size);
+    auto packedSize = job.codec->compress(result.data.data(), job.size, packed.data(), job.size - 1);
+    if (packedSize == 0)
+        return;  // Doesn't compress, keep as is
+
+    packed.resize(packedSize);
+    result.data.swap(packed);
+    result.compressed = true;
+}
+
+void FileWriter::copyFileData(std::ostream& of, OutputFile& out, const EntryData& file) {
+    RandomAccessFile in;
+    in.open(file.originalPath);
+    if (in.size() != file.size)
+        throw std::runtime_error("File was changed while saving");
+
+    of.flush();  // Buffered writes must land before the copy, which bypasses the stream
+    unsigned long long position = of.tellp();
+    out.copyFrom(in, 0, position, file.size);
+    of.seekp(position + file.size);
+    if (!of)
+        throw std::runtime_error("Unable to write file");
 }
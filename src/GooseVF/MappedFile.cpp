@@ -0,0 +1,129 @@
+#include "GooseVF/MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace GooseVF;
+
+MappedFile::MappedFile() {
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+void MappedFile::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("File not found");
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        throw std::runtime_error("Unable to get file size");
+    }
+
+    _fileHandle = file;
+    _size = static_cast<size_t>(fileSize.QuadPart);
+    _opened = true;
+    if (_size == 0)
+        return;  // Empty files can't be mapped
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        close();
+        throw std::runtime_error("Unable to map file");
+    }
+    _mappingHandle = mapping;
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        close();
+        throw std::runtime_error("Unable to map file");
+    }
+    _data = static_cast<const char*>(view);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("File not found");
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Unable to get file size");
+    }
+
+    _size = static_cast<size_t>(st.st_size);
+    _opened = true;
+    if (_size == 0) {
+        ::close(fd);
+        return;  // Empty files can't be mapped
+    }
+
+    void* view = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);  // Mapping keeps its own reference to the file
+    if (view == MAP_FAILED) {
+        _opened = false;
+        _size = 0;
+        throw std::runtime_error("Unable to map file");
+    }
+    _data = static_cast<const char*>(view);
+#endif
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (_data != nullptr)
+        UnmapViewOfFile(_data);
+    if (_mappingHandle != nullptr)
+        CloseHandle(_mappingHandle);
+    if (_fileHandle != nullptr)
+        CloseHandle(_fileHandle);
+    _mappingHandle = nullptr;
+    _fileHandle = nullptr;
+#else
+    if (_data != nullptr)
+        munmap(const_cast<char*>(_data), _size);
+#endif
+    _data = nullptr;
+    _size = 0;
+    _opened = false;
+}
+
+bool MappedFile::isOpen() const {
+    return _opened;
+}
+
+const char* MappedFile::data() const {
+    return _data;
+}
+
+size_t MappedFile::size() const {
+    return _size;
+}
+
+void MappedFile::advise(unsigned long long offset, unsigned long long size) const {
+    if (!_opened || offset >= _size)
+        return;
+    if (size > _size - offset)
+        size = _size - offset;
+
+#ifndef _WIN32
+    unsigned long long page = sysconf(_SC_PAGESIZE);
+    auto begin = offset & ~(page - 1);  // madvise needs page-aligned address
+    madvise(const_cast<char*>(_data) + begin, offset + size - begin, MADV_WILLNEED);
+#endif
+}
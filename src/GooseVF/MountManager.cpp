@@ -0,0 +1,243 @@
+#include "GooseVF/MountManager.h"
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+
+#include "GooseVF/Utility.h"
+
+using namespace GooseVF;
+
+MountManager::LayerId MountManager::mount(const std::string& path, int priority, OpenMode mode) {
+    auto layer = std::make_unique<Layer>();
+    layer->priority = priority;
+    layer->reader = std::make_unique<FileReader>(path, mode);  // Opened before locking, other lookups go on meanwhile
+
+    auto& reader = *layer->reader;
+    reader.loadAll();  // Merged index needs every path, lazy mode only delays it
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    layer->id = _nextId++;
+    reader.setVerifyMode(_verifyMode);
+    reader.setCacheSize(_cacheSize);
+
+    // Path hashes are already in the archive index, nothing is rehashed
+    reserve(_slotCount + reader._nodeCount);
+    for (size_t i = 0; i < reader._indexCapacity; i++) {
+        auto& slot = reader._index[i];
+        if (slot.entry != FileReader::NO_NODE)
+            insert(Slot{slot.hash, layer.get(), slot.entry});
+    }
+
+    _layers.push_back(std::move(layer));
+    return _layers.back()->id;
+}
+
+void MountManager::unmount(LayerId id) {
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    auto it = std::find_if(_layers.begin(), _layers.end(), [id](const std::unique_ptr<Layer>& layer) { return layer->id == id; });
+    if (it == _layers.end())
+        throw std::runtime_error("Archive is not mounted");
+
+    // Only slots of this archive are touched, the rest of the index stays as is
+    auto& reader = *(*it)->reader;
+    for (size_t i = 0; i < reader._indexCapacity; i++) {
+        auto& slot = reader._index[i];
+        if (slot.entry != FileReader::NO_NODE)
+            erase(slot.hash, it->get(), slot.entry);
+    }
+    _layers.erase(it);
+}
+
+void MountManager::setVerifyMode(VerifyMode mode) {
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    _verifyMode = mode;
+    for (auto& layer : _layers) {
+        layer->reader->setVerifyMode(mode);
+    }
+}
+
+void MountManager::setCacheSize(unsigned long long bytes) {
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    _cacheSize = bytes;
+    for (auto& layer : _layers) {
+        layer->reader->setCacheSize(bytes);
+    }
+}
+
+size_t MountManager::layerCount() const {
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    return _layers.size();
+}
+
+void MountManager::readFile(std::string_view path, std::vector<char>& output) const {
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    const FileReader* reader;
+    auto* node = findFile(path, reader);
+#ifdef GOOSEVF_ENABLE_STATS
+    auto start = FileReader::statsClock();
+#endif
+    reader->loadEntry(node, output);
+#ifdef GOOSEVF_ENABLE_STATS
+    reader->recordRead(node, path, 0, node->size, start);
+#endif
+}
+
+SharedBuffer MountManager::readFileShared(std::string_view path) const {
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    const FileReader* reader;
+    auto* node = findFile(path, reader);
+#ifdef GOOSEVF_ENABLE_STATS
+    auto start = FileReader::statsClock();
+    auto buffer = reader->sharedEntry(node);
+    reader->recordRead(node, path, 0, node->size, start);
+    return buffer;
+#else
+    return reader->sharedEntry(node);
+#endif
+}
+
+FileView MountManager::readFileView(std::string_view path) const {
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    const FileReader* reader;
+    auto* node = findFile(path, reader);
+#ifdef GOOSEVF_ENABLE_STATS
+    auto start = FileReader::statsClock();
+    auto view = reader->viewEntry(node);
+    reader->recordRead(node, path, 0, view.size(), start);
+    return view;
+#else
+    return reader->viewEntry(node);
+#endif
+}
+
+size_t MountManager::readFileRange(std::string_view path, unsigned long long offset, char* output, size_t size) const {
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    const FileReader* reader;
+    auto* node = findFile(path, reader);
+#ifdef GOOSEVF_ENABLE_STATS
+    auto start = FileReader::statsClock();
+    auto done = reader->readEntryRange(node, offset, output, size);
+    reader->recordRead(node, path, offset, done, start);
+    return done;
+#else
+    return reader->readEntryRange(node, offset, output, size);
+#endif
+}
+
+const FileReader* MountManager::owner(std::string_view path) const {
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto* slot = find(path);
+    return slot == nullptr ? nullptr : slot->layer->reader.get();
+}
+
+bool MountManager::exists(std::string_view path) const {
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    return find(path) != nullptr;
+}
+
+bool MountManager::is_file(std::string_view path) const {
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto* slot = find(path);
+    return slot != nullptr && slot->layer->reader->_nodes[slot->node].type == ENTRYDATA_TYPE_FILE;
+}
+
+bool MountManager::is_dir(std::string_view path) const {
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto* slot = find(path);
+    return slot != nullptr && slot->layer->reader->_nodes[slot->node].type == ENTRYDATA_TYPE_DIR;
+}
+
+bool MountManager::precedes(const Layer* a, const Layer* b) {
+    if (a->priority != b->priority)
+        return a->priority > b->priority;
+    return a->id > b->id;
+}
+
+void MountManager::reserve(size_t count) {
+    if (count * 2 <= _slots.size())
+        return;
+
+    size_t capacity = 16;
+    while (capacity < count * 2)
+        capacity <<= 1;
+
+    auto slots = std::move(_slots);
+    _slots.assign(capacity, Slot{0, nullptr, 0});
+    _slotCount = 0;
+    for (auto& slot : slots) {
+        if (slot.layer != nullptr)
+            insert(slot);
+    }
+}
+
+void MountManager::insert(Slot slot) {
+    auto mask = _slots.size() - 1;
+    for (auto i = slot.hash & mask;; i = (i + 1) & mask) {
+        auto& current = _slots[i];
+        if (current.layer == nullptr) {
+            current = slot;
+            _slotCount++;
+            return;
+        }
+        // Displaced slot has the same hash, so it keeps probing from the same place
+        if (current.hash == slot.hash && precedes(slot.layer, current.layer))
+            std::swap(current, slot);
+    }
+}
+
+void MountManager::erase(unsigned long long hash, const Layer* layer, unsigned int node) {
+    auto mask = _slots.size() - 1;
+    auto i = hash & mask;
+    while (_slots[i].layer != layer || _slots[i].node != node) {
+        if (_slots[i].layer == nullptr)
+            return;
+        i = (i + 1) & mask;
+    }
+
+    // Backward shift deletion: following slots which can live closer to their home move into the gap.
+    // Slots never overtake each other, so the order of equal hashes is preserved
+    for (auto j = (i + 1) & mask; _slots[j].layer != nullptr; j = (j + 1) & mask) {
+        auto home = _slots[j].hash & mask;
+        bool between = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (between)
+            continue;
+        _slots[i] = _slots[j];
+        i = j;
+    }
+    _slots[i] = Slot{0, nullptr, 0};
+    _slotCount--;
+}
+
+const MountManager::Slot* MountManager::find(std::string_view path) const {
+    if (_slots.empty())
+        return nullptr;
+
+    unsigned long long hash;
+    if (hashPath(path, hash) == 0)
+        return nullptr;
+
+    auto mask = _slots.size() - 1;
+    for (auto i = hash & mask; _slots[i].layer != nullptr; i = (i + 1) & mask) {
+        auto& slot = _slots[i];
+        if (slot.hash != hash)
+            continue;
+
+        auto& reader = *slot.layer->reader;
+        if (reader.matchesPath(&reader._nodes[slot.node], path))
+            return &slot;
+    }
+    return nullptr;
+}
+
+const FileReader::FileTreeNode* MountManager::findFile(std::string_view path, const FileReader*& reader) const {
+    auto* slot = find(path);
+    if (slot == nullptr)
+        throw std::runtime_error("File not found.");
+
+    reader = slot->layer->reader.get();
+    auto* node = &reader->_nodes[slot->node];
+    if (node->type != ENTRYDATA_TYPE_FILE)
+        throw std::runtime_error("File not found.");
+    reader->recordAccess(node);
+    return node;
+}
@@ -0,0 +1,139 @@
+#include "GooseVF/OutputFile.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#define COPY_BUFFER_SIZE (4 << 20)
+
+using namespace GooseVF;
+
+OutputFile::OutputFile() {
+}
+
+OutputFile::~OutputFile() {
+    close();
+}
+
+void OutputFile::open(const std::string& path, bool truncate) {
+    close();
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Unable to create file");
+    _handle = handle;
+#else
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+    if (fd < 0)
+        throw std::runtime_error("Unable to create file");
+    _fd = fd;
+#endif
+}
+
+void OutputFile::close() {
+#ifdef _WIN32
+    if (_handle != nullptr)
+        CloseHandle(_handle);
+    _handle = nullptr;
+#else
+    if (_fd >= 0)
+        ::close(_fd);
+    _fd = -1;
+#endif
+}
+
+bool OutputFile::isOpen() const {
+#ifdef _WIN32
+    return _handle != nullptr;
+#else
+    return _fd >= 0;
+#endif
+}
+
+void OutputFile::writeAt(unsigned long long offset, const char* data, size_t size) {
+    if (!isOpen())
+        throw std::runtime_error("File is not opened");
+
+    while (size > 0) {
+#ifdef _WIN32
+        DWORD toWrite = size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(size);
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD written = 0;
+        if (!WriteFile(_handle, data, toWrite, &written, &overlapped) || written == 0)
+            throw std::runtime_error("Unable to write file");
+#else
+        ssize_t written = pwrite(_fd, data, size, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            throw std::runtime_error("Unable to write file");
+#endif
+        data += written;
+        offset += written;
+        size -= written;
+    }
+}
+
+void OutputFile::copyFrom(const RandomAccessFile& source, unsigned long long sourceOffset, unsigned long long offset, unsigned long long size) {
+    if (!isOpen() || !source.isOpen())
+        throw std::runtime_error("File is not opened");
+    if (sourceOffset + size > source.size())
+        throw std::runtime_error("Read is out of file bounds");
+
+#ifdef __linux__
+    while (size > 0) {
+        loff_t in = sourceOffset;
+        loff_t out = offset;
+        ssize_t copied = copy_file_range(source._fd, &in, _fd, &out, size, 0);
+        if (copied < 0 && errno == EINTR)
+            continue;
+        if (copied <= 0)
+            break;  // Not supported for this pair of files, try next method
+        sourceOffset += copied;
+        offset += copied;
+        size -= copied;
+    }
+
+    if (size > 0 && lseek(_fd, static_cast<off_t>(offset), SEEK_SET) >= 0) {
+        while (size > 0) {
+            off_t in = sourceOffset;
+            ssize_t copied = sendfile(_fd, source._fd, &in, std::min<unsigned long long>(size, 0x7FFFF000));
+            if (copied < 0 && errno == EINTR)
+                continue;
+            if (copied <= 0)
+                break;
+            sourceOffset += copied;
+            offset += copied;
+            size -= copied;
+        }
+    }
+#endif
+
+    std::vector<char> buffer(std::min<unsigned long long>(size, COPY_BUFFER_SIZE));
+    while (size > 0) {
+        auto toCopy = std::min<unsigned long long>(size, buffer.size());
+        source.readAt(sourceOffset, buffer.data(), toCopy);
+        writeAt(offset, buffer.data(), toCopy);
+        sourceOffset += toCopy;
+        offset += toCopy;
+        size -= toCopy;
+    }
+}
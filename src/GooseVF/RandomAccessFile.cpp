@@ -0,0 +1,339 @@
+#include "GooseVF/RandomAccessFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(GOOSEVF_IO_URING) && defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define IO_RING_ENTRIES 64
+#define IO_RING_MAX_READ (1U << 30)  // Longer requests are submitted in parts
+#endif
+
+using namespace GooseVF;
+
+#if defined(GOOSEVF_IO_URING) && defined(__linux__)
+namespace GooseVF {
+    // Minimal io_uring wrapper over raw system calls, only what positional reads need
+    class IoRing {
+       public:
+        IoRing(const IoRing&) = delete;
+        IoRing& operator=(const IoRing&) = delete;
+
+        IoRing() {
+            io_uring_params params = {};
+            int fd = syscall(__NR_io_uring_setup, IO_RING_ENTRIES, &params);
+            if (fd < 0)
+                return;  // Not supported or not allowed
+            _fd = fd;
+
+            _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+            _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+                _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+
+            _sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+            if (_sqRing == MAP_FAILED) {
+                _sqRing = nullptr;
+                return;
+            }
+            if (params.features & IORING_FEAT_SINGLE_MMAP) {
+                _cqRing = _sqRing;
+            } else {
+                _cqRing = mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+                if (_cqRing == MAP_FAILED) {
+                    _cqRing = nullptr;
+                    return;
+                }
+            }
+            _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            void* sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+            if (sqes == MAP_FAILED)
+                return;
+            _sqes = static_cast<io_uring_sqe*>(sqes);
+
+            auto* sq = static_cast<char*>(_sqRing);
+            _sqTail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+            _sqMask = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+            _sqArray = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+            _sqEntries = params.sq_entries;
+
+            auto* cq = static_cast<char*>(_cqRing);
+            _cqHead = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+            _cqTail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+            _cqMask = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+            _cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        }
+
+        ~IoRing() {
+            if (_sqes != nullptr)
+                munmap(_sqes, _sqesSize);
+            if (_cqRing != nullptr && _cqRing != _sqRing)
+                munmap(_cqRing, _cqRingSize);
+            if (_sqRing != nullptr)
+                munmap(_sqRing, _sqRingSize);
+            if (_fd >= 0)
+                ::close(_fd);
+        }
+
+        bool isReady() const {
+            return _sqes != nullptr;
+        }
+
+        unsigned int capacity() const {
+            return _sqEntries;
+        }
+
+        // Only queues the read, submit() hands queued reads to the kernel
+        void queueRead(int fd, unsigned long long offset, char* buffer, unsigned int size, unsigned long long tag) {
+            auto tail = *_sqTail;
+            auto index = tail & _sqMask;
+            auto& sqe = _sqes[index];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_READ;
+            sqe.fd = fd;
+            sqe.off = offset;
+            sqe.addr = reinterpret_cast<unsigned long long>(buffer);
+            sqe.len = size;
+            sqe.user_data = tag;
+            _sqArray[index] = index;
+            __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+            _queued++;
+        }
+
+        // Submits queued reads and waits for at least one completion
+        bool submit() {
+            while (true) {
+                int result = syscall(__NR_io_uring_enter, _fd, _queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (result >= 0) {
+                    _queued -= result;
+                    return true;
+                }
+                if (errno != EINTR)
+                    return false;
+            }
+        }
+
+        template <typename Callback>
+        void reap(Callback callback) {
+            auto head = *_cqHead;
+            auto tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++) {
+                auto& cqe = _cqes[head & _cqMask];
+                callback(cqe.user_data, cqe.res);
+            }
+            __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+        }
+
+       private:
+        int _fd = -1;
+        void* _sqRing = nullptr;
+        void* _cqRing = nullptr;
+        size_t _sqRingSize = 0;
+        size_t _cqRingSize = 0;
+        size_t _sqesSize = 0;
+
+        io_uring_sqe* _sqes = nullptr;
+        unsigned int* _sqTail = nullptr;
+        unsigned int* _sqArray = nullptr;
+        unsigned int _sqMask = 0;
+        unsigned int _sqEntries = 0;
+        unsigned int _queued = 0;
+
+        unsigned int* _cqHead = nullptr;
+        unsigned int* _cqTail = nullptr;
+        unsigned int _cqMask = 0;
+        io_uring_cqe* _cqes = nullptr;
+    };
+}  // namespace GooseVF
+#else
+namespace GooseVF {
+    class IoRing {};  // Batches are read one by one
+}  // namespace GooseVF
+#endif
+
+RandomAccessFile::RandomAccessFile() {
+}
+
+RandomAccessFile::~RandomAccessFile() {
+    close();
+}
+
+void RandomAccessFile::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("File not found");
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize)) {
+        CloseHandle(handle);
+        throw std::runtime_error("Unable to get file size");
+    }
+    _handle = handle;
+    _size = static_cast<unsigned long long>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("File not found");
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Unable to get file size");
+    }
+    _fd = fd;
+    _size = static_cast<unsigned long long>(st.st_size);
+#endif
+}
+
+void RandomAccessFile::close() {
+    _ring.reset();
+
+#ifdef _WIN32
+    if (_handle != nullptr)
+        CloseHandle(_handle);
+    _handle = nullptr;
+#else
+    if (_fd >= 0)
+        ::close(_fd);
+    _fd = -1;
+#endif
+    _size = 0;
+}
+
+bool RandomAccessFile::isOpen() const {
+#ifdef _WIN32
+    return _handle != nullptr;
+#else
+    return _fd >= 0;
+#endif
+}
+
+unsigned long long RandomAccessFile::size() const {
+    return _size;
+}
+
+void RandomAccessFile::readAt(unsigned long long offset, char* buffer, size_t size) const {
+    if (!isOpen())
+        throw std::runtime_error("File is not opened");
+    if (offset + size > _size)
+        throw std::runtime_error("Read is out of file bounds");
+
+    while (size > 0) {
+#ifdef _WIN32
+        DWORD toRead = size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(size);
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD actualRead = 0;
+        if (!ReadFile(_handle, buffer, toRead, &actualRead, &overlapped) || actualRead == 0)
+            throw std::runtime_error("Unable to read file");
+#else
+        ssize_t actualRead = pread(_fd, buffer, size, static_cast<off_t>(offset));
+        if (actualRead < 0 && errno == EINTR)
+            continue;
+        if (actualRead <= 0)
+            throw std::runtime_error("Unable to read file");
+#endif
+        buffer += actualRead;
+        offset += actualRead;
+        size -= actualRead;
+    }
+}
+
+void RandomAccessFile::readBatch(const std::vector<ReadRequest>& requests) const {
+    if (!isOpen())
+        throw std::runtime_error("File is not opened");
+    for (auto& request : requests) {
+        if (request.offset + request.size > _size)
+            throw std::runtime_error("Read is out of file bounds");
+    }
+
+#if defined(GOOSEVF_IO_URING) && defined(__linux__)
+    std::unique_lock<std::mutex> lock(_ringMutex, std::try_to_lock);
+    if (lock.owns_lock() && _ring == nullptr)
+        _ring = std::make_unique<IoRing>();  // Kept even if not ready, so setup isn't retried on every batch
+    if (lock.owns_lock() && _ring->isReady()) {
+        auto& ring = *_ring;
+        std::vector<ReadRequest> pending(requests);  // Advanced on short reads
+        std::vector<size_t> failed;
+        size_t next = 0;
+        unsigned int inFlight = 0;
+
+        auto queue = [&](size_t i) {
+            auto size = static_cast<unsigned int>(std::min<size_t>(pending[i].size, IO_RING_MAX_READ));
+            ring.queueRead(_fd, pending[i].offset, pending[i].buffer, size, i);
+            inFlight++;
+        };
+
+        while (next < pending.size() || inFlight > 0) {
+            while (next < pending.size() && inFlight < ring.capacity()) {
+                if (pending[next].size > 0)
+                    queue(next);
+                next++;
+            }
+            if (inFlight == 0)
+                break;
+            if (!ring.submit()) {
+                _ring.reset();  // Its queue state is unknown now
+                throw std::runtime_error("Unable to read file");
+            }
+
+            std::vector<size_t> retry;
+            ring.reap([&](unsigned long long i, int result) {
+                inFlight--;
+                if (result == -EINTR || result == -EAGAIN) {
+                    retry.push_back(i);
+                } else if (result <= 0) {
+                    failed.push_back(i);  // Finished below with plain reads, which report the error
+                } else {
+                    pending[i].offset += result;
+                    pending[i].buffer += result;
+                    pending[i].size -= result;
+                    if (pending[i].size > 0)
+                        retry.push_back(i);
+                }
+            });
+            for (auto i : retry) {
+                queue(i);
+            }
+        }
+
+        for (auto i : failed) {
+            readAt(pending[i].offset, pending[i].buffer, pending[i].size);
+        }
+        return;
+    }
+#endif
+
+    for (auto& request : requests) {
+        readAt(request.offset, request.buffer, request.size);
+    }
+}
+
+void RandomAccessFile::advise(unsigned long long offset, unsigned long long size) const {
+    if (!isOpen() || offset >= _size)
+        return;
+
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(_fd, static_cast<off_t>(offset), static_cast<off_t>(std::min(size, _size - offset)), POSIX_FADV_WILLNEED);
+#endif
+}
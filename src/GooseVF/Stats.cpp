@@ -0,0 +1,32 @@
+#include "GooseVF/Stats.h"
+
+using namespace GooseVF;
+
+unsigned long long LatencyHistogram::count() const {
+    unsigned long long total = 0;
+    for (auto count : counts) {
+        total += count;
+    }
+    return total;
+}
+
+unsigned long long LatencyHistogram::percentile(double fraction) const {
+    auto total = count();
+    if (total == 0)
+        return 0;
+
+    auto target = static_cast<unsigned long long>(fraction * total);
+    unsigned long long seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen > target || (seen == total && seen > 0))
+            return i == 0 ? 0 : 1ULL << i;
+    }
+    return 1ULL << (BUCKETS - 1);
+}
+
+void LatencyHistogram::add(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKETS; i++) {
+        counts[i] += other.counts[i];
+    }
+}
@@ -1,25 +1,191 @@
 #include "GooseVF/Utility.h"
 
-#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
 
-std::vector<std::string> GooseVF::splitPath(const std::string& s) {
-    std::stringstream stream(s);
-    std::string segment;
-    std::vector<std::string> parts;
+namespace {
+    unsigned long long mix(unsigned long long x) {
+        x ^= x >> 33;
+        x *= 0xFF51AFD7ED558CCDULL;
+        x ^= x >> 33;
+        x *= 0xC4CEB9FE1A85EC53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+}  // namespace
+
+namespace {
+    bool isSeparator(char c) {
+        return c == '\\' || c == '/';
+    }
+
+    bool isSkipped(std::string_view name) {
+        return name.empty() || name == ".";
+    }
+}  // namespace
 
-    while (std::getline(stream, segment, '\\')) {
-        parts.push_back(segment);
+bool GooseVF::PathTokenizer::next(std::string_view& name) {
+    while (!_path.empty()) {
+        size_t end = 0;
+        while (end < _path.size() && !isSeparator(_path[end]))
+            end++;
+        name = _path.substr(0, end);
+        _path.remove_prefix(std::min(end + 1, _path.size()));
+        if (!isSkipped(name))
+            return true;
+    }
+    return false;
+}
+
+bool GooseVF::PathTokenizer::nextFromEnd(std::string_view& name) {
+    while (!_path.empty()) {
+        size_t begin = _path.size();
+        while (begin > 0 && !isSeparator(_path[begin - 1]))
+            begin--;
+        name = _path.substr(begin);
+        _path.remove_suffix(_path.size() - (begin > 0 ? begin - 1 : 0));
+        if (!isSkipped(name))
+            return true;
+    }
+    return false;
+}
+
+bool GooseVF::PathTokenizer::empty() const {
+    std::string_view name;
+    auto rest = *this;
+    return !rest.next(name);
+}
+
+std::vector<std::string> GooseVF::splitPath(std::string_view s) {
+    std::vector<std::string> parts;
+    PathTokenizer tokenizer(s);
+    std::string_view name;
+    while (tokenizer.next(name)) {
+        parts.emplace_back(name);
     }
     return parts;
 }
 
 std::string GooseVF::buildPath(const std::vector<std::string>& s) {
-    std::stringstream stream;
-    auto it = s.begin();
-    stream << *it++;
-    for (; it != s.end(); it++) {
-        stream << '\\';
-        stream << *it;
-    }
-    return stream.str();
+    std::string path;
+    for (auto& part : s) {
+        if (!path.empty())
+            path += '\\';
+        path += part;
+    }
+    return path;
+}
+
+bool GooseVF::equalsFolded(std::string_view stored, std::string_view name) {
+    if (stored.size() != name.size())
+        return false;
+    for (size_t i = 0; i < name.size(); i++) {
+        if (foldCase(stored[i]) != foldCase(name[i]))
+            return false;
+    }
+    return true;
+}
+
+int GooseVF::compareFolded(std::string_view stored, std::string_view name) {
+    auto length = std::min(stored.size(), name.size());
+    for (size_t i = 0; i < length; i++) {
+        auto a = static_cast<unsigned char>(foldCase(stored[i]));
+        auto b = static_cast<unsigned char>(foldCase(name[i]));
+        if (a != b)
+            return a < b ? -1 : 1;
+    }
+    return (stored.size() < name.size()) ? -1 : (stored.size() > name.size() ? 1 : 0);
+}
+
+unsigned long long GooseVF::hashString(std::string_view s, unsigned long long seed) {
+    auto hash = seed;
+    for (unsigned char c : s) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+unsigned long long GooseVF::hashFolded(std::string_view s, unsigned long long seed) {
+    auto hash = seed;
+    for (char c : s) {
+        hash ^= static_cast<unsigned char>(foldCase(c));
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+unsigned long long GooseVF::hashPath(const std::vector<std::string>& parts) {
+    auto hash = hashString("");
+    for (size_t i = 0; i < parts.size(); i++) {
+        if (i > 0)
+            hash = hashString("\\", hash);
+        hash = hashString(parts[i], hash);
+    }
+    return hash;
+}
+
+size_t GooseVF::hashPath(std::string_view path, unsigned long long& hash, size_t maxNames) {
+    hash = hashString("");
+    PathTokenizer tokenizer(path);
+    std::string_view name;
+    size_t count = 0;
+    while (count < maxNames && tokenizer.next(name)) {
+        if (count++ > 0)
+            hash = hashString("\\", hash);
+        hash = hashFolded(name, hash);
+    }
+    return count;
+}
+
+unsigned long long GooseVF::hashData(const char* data, size_t size, unsigned long long seed) {
+    const auto multiplier = 0x9E3779B97F4A7C15ULL;
+    auto hash = seed ^ (size * multiplier);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        unsigned long long word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ mix(word)) * multiplier;
+    }
+    if (i < size) {
+        unsigned long long word = 0;
+        std::memcpy(&word, data + i, size - i);
+        hash = (hash ^ mix(word)) * multiplier;
+    }
+    return mix(hash);
+}
+
+void GooseVF::parallelFor(size_t count, unsigned int threads, const std::function<void(size_t)>& task) {
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto work = [&]() {
+        for (auto i = next++; i < count; i = next++) {
+            try {
+                task(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                    error = std::current_exception();
+                next = count;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int i = 1; i < std::min<size_t>(threads, count); i++) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    if (error)
+        std::rethrow_exception(error);
 }